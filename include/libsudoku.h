@@ -0,0 +1,249 @@
+#ifndef LIBSUDOKU_H
+#define LIBSUDOKU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <preemptive_set.h>
+
+/*
+ * Every function that can fail returns one of these codes, none of
+ * them exits the program. A context only holds the state of one grid,
+ * several contexts can be used at the same time in different threads.
+ */
+typedef enum sudoku_status {
+  SUDOKU_OK = 0,      /* success, for a solver: the grid is solved */
+  SUDOKU_UNSOLVABLE,  /* the grid is inconsistent and has no solution */
+  SUDOKU_ENOMEM,      /* out of memory */
+  SUDOKU_ESIZE,       /* wrong grid size */
+  SUDOKU_EPARSE,      /* malformed input */
+  SUDOKU_EINVAL       /* no grid was parsed or generated */
+} sudoku_status_t;
+
+typedef struct sudoku_ctx sudoku_ctx_t;
+
+/*
+ * The searches a context can solve its grids with: backtracking on
+ * the cell with the fewest candidates after propagating the
+ * heuristics (the default) or an exact cover search on dancing links
+ */
+typedef enum sudoku_engine {
+  SUDOKU_ENGINE_HEURISTICS = 0,
+  SUDOKU_ENGINE_DLX
+} sudoku_engine_t;
+
+/*
+ * How the heuristics engine chooses the cell and the value it tries
+ * when the propagation is stuck. The cell always has the fewest
+ * candidates, MRV takes the first such cell and the smallest value
+ * (the default). The others take the cell with the most unsolved
+ * peers, then the smallest value (DEGREE), the value held by the
+ * fewest peers (LCV, the least constraining one) or the value held by
+ * the most peers (PEERS).
+ */
+typedef enum sudoku_branch {
+  SUDOKU_BRANCH_MRV = 0,
+  SUDOKU_BRANCH_DEGREE,
+  SUDOKU_BRANCH_LCV,
+  SUDOKU_BRANCH_PEERS
+} sudoku_branch_t;
+
+/*
+ * `sudoku_ctx_new` returns a new context without any grid or NULL if
+ * it is out of memory. `sudoku_ctx_free` frees the context and its
+ * grid, in case of a NULL argument it does nothing.
+ */
+sudoku_ctx_t* sudoku_ctx_new (void);
+void sudoku_ctx_free (sudoku_ctx_t* ctx);
+
+/*
+ * `sudoku_set_verbose` writes the progress of the solver on `stream`,
+ * or disables it if `stream` is NULL (the default). `sudoku_set_strict`
+ * makes the generator produce grids with only one solution and
+ * `sudoku_set_seed` seeds its random choices.
+ */
+void sudoku_set_verbose (sudoku_ctx_t* ctx, FILE* stream);
+void sudoku_set_strict (sudoku_ctx_t* ctx, bool strict);
+void sudoku_set_seed (sudoku_ctx_t* ctx, uint64_t seed);
+
+/*
+ * `sudoku_set_engine` chooses the search used to solve the grids and
+ * to count their solutions. `sudoku_engine_name` and `sudoku_engine_parse`
+ * convert an engine to its name ("heuristics" or "dlx") and back, the
+ * latter returns SUDOKU_EINVAL for an unknown name.
+ */
+void sudoku_set_engine (sudoku_ctx_t* ctx, sudoku_engine_t engine);
+const char* sudoku_engine_name (sudoku_engine_t engine);
+sudoku_status_t sudoku_engine_parse (const char* name,
+				     sudoku_engine_t* engine);
+
+/*
+ * `sudoku_set_branch` chooses the branching strategy of the heuristics
+ * engine, the exact cover search has its own. `sudoku_branch_name` and
+ * `sudoku_branch_parse` convert a strategy to its name ("mrv",
+ * "degree", "lcv" or "peers") and back, the latter returns
+ * SUDOKU_EINVAL for an unknown name.
+ */
+void sudoku_set_branch (sudoku_ctx_t* ctx, sudoku_branch_t branch);
+const char* sudoku_branch_name (sudoku_branch_t branch);
+sudoku_status_t sudoku_branch_parse (const char* name,
+				     sudoku_branch_t* branch);
+
+/*
+ * `sudoku_set_restarts` makes the heuristics engine start its search
+ * over after `dead_ends` dead ends, then after `dead_ends` times the
+ * terms of the Luby sequence (1 1 2 1 1 2 4...), breaking the ties of
+ * its branching at random so that every run takes another path. It
+ * keeps what it proved without any choice, so it still finds every
+ * answer. 0 (the default) never restarts.
+ */
+#define SUDOKU_DEFAULT_RESTARTS 64
+
+void sudoku_set_restarts (sudoku_ctx_t* ctx, unsigned long dead_ends);
+
+/*
+ * `sudoku_set_learning` turns on or off (the default) the conflict
+ * analysis of the heuristics engine: it keeps track of the choices
+ * each cell depends on, so that a conflict undoes at once all the
+ * choices it doesn't depend on, and learns the conflicts of its first
+ * few choices as nogoods which prune the rest of the search.
+ */
+void sudoku_set_learning (sudoku_ctx_t* ctx, bool learning);
+
+/*
+ * `sudoku_set_probing` makes the heuristics engine probe the candidates
+ * of up to `cells` cells of least cardinality (at most 64) before each
+ * choice: every candidate is propagated as if it were chosen and ruled
+ * out if that leads to a conflict. 0 (the default) never probes.
+ */
+#define SUDOKU_DEFAULT_PROBES 4
+
+void sudoku_set_probing (sudoku_ctx_t* ctx, size_t cells);
+
+/*
+ * `sudoku_set_hidden_sets` and `sudoku_set_fish` add heuristics to the
+ * propagation, both off by default: hidden pairs and triples (two or
+ * three colors which can only go in as many cells of a unit), and
+ * X-Wings and Swordfish (a color which can only go in as many columns
+ * of two or three rows, or the other way round). They rule out more
+ * candidates, and so save choices, at the price of a slower
+ * propagation.
+ */
+void sudoku_set_hidden_sets (sudoku_ctx_t* ctx, bool hidden_sets);
+void sudoku_set_fish (sudoku_ctx_t* ctx, bool fish);
+
+/*
+ * `sudoku_parse` reads a grid written on several lines from the
+ * stream `in`, which it doesn't close. `sudoku_parse_line` reads a
+ * grid written on a single line of `len` characters where '0', '.'
+ * and '_' stand for an empty cell. Both replace the grid of the
+ * context, and on error `sudoku_error` tells what is wrong.
+ */
+sudoku_status_t sudoku_parse (sudoku_ctx_t* ctx, FILE* in);
+sudoku_status_t sudoku_parse_line (sudoku_ctx_t* ctx, const char* line,
+				   size_t len);
+
+/*
+ * Solves the grid of the context in place. Returns SUDOKU_OK when
+ * the grid has been solved and SUDOKU_UNSOLVABLE when it has no
+ * solution.
+ *
+ * `sudoku_solve_portfolio` solves it the same way with `searches`
+ * searches racing on as many threads: one with the configuration of
+ * the context and the others restarting with their own seeds and
+ * branching strategies. The first one to solve the grid or to find it
+ * unsolvable gives the answer and stops the others, an error is only
+ * returned if they all fail. The counters of the context get the work
+ * of all of them.
+ */
+sudoku_status_t sudoku_solve (sudoku_ctx_t* ctx);
+sudoku_status_t sudoku_solve_portfolio (sudoku_ctx_t* ctx, size_t searches);
+
+/*
+ * `sudoku_count` counts the solutions of the grid of the context in
+ * `count`, and stops as soon as it has found `limit` of them (never if
+ * `limit` is 0). `sudoku_is_unique` tells whether the grid has exactly
+ * one solution, for which it looks for two at most. Both leave the
+ * grid unchanged.
+ */
+sudoku_status_t sudoku_count (sudoku_ctx_t* ctx, unsigned long limit,
+			      unsigned long* count);
+sudoku_status_t sudoku_is_unique (sudoku_ctx_t* ctx, bool* unique);
+
+/*
+ * Replaces the grid of the context by a new grid of size `size` to be
+ * solved, which has only one solution in strict mode.
+ */
+sudoku_status_t sudoku_generate (sudoku_ctx_t* ctx, size_t size);
+
+/*
+ * `sudoku_grid_size` returns the size of the grid of the context or 0
+ * if there is none. `sudoku_print` prints it on `out` in the format
+ * read by `sudoku_parse` and `sudoku_to_line` writes it on `line`,
+ * which must hold at least size * size + 1 characters, in the format
+ * read by `sudoku_parse_line`.
+ */
+size_t sudoku_grid_size (const sudoku_ctx_t* ctx);
+void sudoku_print (const sudoku_ctx_t* ctx, FILE* out);
+void sudoku_to_line (const sudoku_ctx_t* ctx, char line[]);
+
+/*
+ * Stages of the propagation, in the order they run: singles (cross-
+ * hatching and lone number), locked candidates, naked sets, hidden
+ * sets and fish
+ */
+#define SUDOKU_STAGES 5
+
+typedef struct sudoku_stage_stats {
+  unsigned long runs;
+  unsigned long skips;              /* runs skipped by the scheduling */
+  unsigned long work;               /* estimate of the cells looked at */
+} sudoku_stage_stats_t;
+
+/*
+ * Counters of the work done by the solver of a context, they add up
+ * until `sudoku_reset_stats` is called. The eliminations count the
+ * candidates removed by each heuristic. A library built with
+ * SUDOKU_NO_STATS defined doesn't count anything and leaves them to 0.
+ */
+typedef struct sudoku_stats {
+  unsigned long decisions;          /* choices made by the search */
+  unsigned long backtracks;         /* choices undone */
+  unsigned long max_depth;          /* most choices made at once */
+  unsigned long restarts;           /* runs of the search given up */
+  unsigned long backjumps;          /* choices jumped over by conflicts */
+  unsigned long nogoods;            /* nogoods learned */
+  unsigned long probes;             /* candidates probed */
+  unsigned long propagations;       /* runs of the heuristics */
+  unsigned long passes;             /* passes of the heuristics */
+  unsigned long cross_hatching;     /* eliminations */
+  unsigned long lone_number;
+  unsigned long naked_sets;
+  unsigned long locked_candidates;
+  unsigned long nogood_eliminations;
+  unsigned long probe_eliminations;
+  unsigned long hidden_sets;
+  unsigned long fish;
+  sudoku_stage_stats_t stages[SUDOKU_STAGES];
+  double seconds;                   /* wall time spent in sudoku_solve */
+} sudoku_stats_t;
+
+/*
+ * `sudoku_get_stats` copies the counters of the context in `stats`,
+ * `sudoku_add_stats` adds the counters of `stats` to `total` and
+ * `sudoku_print_stats` prints them on `out` as a JSON object
+ */
+void sudoku_get_stats (const sudoku_ctx_t* ctx, sudoku_stats_t* stats);
+void sudoku_reset_stats (sudoku_ctx_t* ctx);
+void sudoku_add_stats (sudoku_stats_t* total, const sudoku_stats_t* stats);
+void sudoku_print_stats (const sudoku_stats_t* stats, FILE* out);
+
+/*
+ * `sudoku_error` returns a message describing the last error of the
+ * context, `sudoku_strerror` a generic one for a status code.
+ */
+const char* sudoku_error (const sudoku_ctx_t* ctx);
+const char* sudoku_strerror (sudoku_status_t status);
+
+#endif /* LIBSUDOKU_H */
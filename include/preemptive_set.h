@@ -17,46 +17,114 @@ typedef uint64_t pset_t;
 pset_t char2pset (char c);
 void pset2str (char string[], pset_t pset);
 
+/*
+ * The operations below are defined in the header so that they get
+ * inlined in the loops of the solver.
+ */
+
 /*
  * `pset_full` returns the pset where all colors are set. The color
  * range is given as a parameter.
  * `pset_empty` just returns the empty set.
  */
-pset_t pset_full (size_t color_range);
-pset_t pset_empty (void);
+static inline pset_t
+pset_full (size_t color_range)
+{
+  return (color_range > MAX_COLORS ? FULL
+	  : FULL >> (MAX_COLORS - color_range));
+}
+
+static inline pset_t
+pset_empty (void)
+{
+  return (0);
+}
 
 /*
  * `pset_set` sets the given color, while `pset_discard` does the
  * oposite.
  */
-pset_t pset_set (pset_t set, char c);
-pset_t pset_discard (pset_t set, char c);
+static inline pset_t
+pset_set (pset_t pset, char c)
+{
+  return (pset | char2pset (c));
+}
+
+static inline pset_t
+pset_discard (pset_t pset, char c)
+{
+  return (pset & (~ char2pset (c)));
+}
 
 /*
  * The familiar boolean operators on sets
  */
-pset_t pset_negate (pset_t pset);
-pset_t pset_and (pset_t pset1, pset_t pset2);
-pset_t pset_or (pset_t pset1, pset_t pset2);
-pset_t pset_xor (pset_t pset1, pset_t pset2);
+static inline pset_t
+pset_negate (pset_t pset)
+{
+  return (~pset);
+}
+
+static inline pset_t
+pset_and (pset_t pset1, pset_t pset2)
+{
+  return (pset1 & pset2);
+}
+
+static inline pset_t
+pset_or (pset_t pset1, pset_t pset2)
+{
+  return (pset1 | pset2);
+}
+
+static inline pset_t
+pset_xor (pset_t pset1, pset_t pset2)
+{
+  return (pset1 ^ pset2);
+}
 
 /*
  * `pset_is_included` checks for set inclusion
  */
-bool pset_is_included (pset_t pset1, pset_t pset2);
+static inline bool
+pset_is_included (pset_t pset1, pset_t pset2)
+{
+  return ((pset1 | pset2) == pset2);
+}
 
 /*
  * `pset_is_singleton` checks if the parameter has only one member.
  * While `pset_cardinality` returns the number of elements on the
  * parameter.
  */
-bool pset_is_singleton (pset_t pset);
-size_t pset_cardinality (pset_t pset);
+static inline bool
+pset_is_singleton (pset_t pset)
+{
+  return (pset == 0 ? false : (pset & (- pset)) == pset);
+}
+
+static inline size_t
+pset_cardinality (pset_t pset)
+{
+  const uint64_t m1  = 0x5555555555555555;
+  const uint64_t m2  = 0x3333333333333333;
+  const uint64_t m4  = 0x0f0f0f0f0f0f0f0f;
+  const uint64_t h01 = 0x0101010101010101;
+
+  pset -= (pset >> 1) & m1;
+  pset = (pset & m2) + ((pset >> 2) & m2);
+  pset = (pset + (pset >> 4)) & m4;
+  return (pset * h01)>>56;
+}
 
 /*
  * Returns a pset with only the leftmost bit set of the pset given as
  * argument
  */
-pset_t pset_leftmost (pset_t pset);
+static inline pset_t
+pset_leftmost (pset_t pset)
+{
+  return (pset_and (pset, pset_negate (pset - 1)));
+}
 
 #endif /* PREEMPTIVE_SET_H */
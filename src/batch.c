@@ -0,0 +1,815 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libsudoku.h>
+#include <preemptive_set.h>
+
+#include "batch.h"
+#include "main.h"
+#include "sudoku.h"
+#include "lockstep.h"
+
+/* Number of lines handed to a solver at once */
+#define BATCH_CHUNK 32
+/* Number of chunks a solver may hold before the reader blocks */
+#define BATCH_INFLIGHT_PER_WORKER 4
+
+/*
+ * A job is a chunk of consecutive lines of the input, `seq` gives its
+ * position in the input so that the results are written in order.
+ */
+typedef struct job {
+  unsigned long seq;
+  unsigned long first_line;   /* line number of the first line */
+  char* text;                 /* the lines, each ending with '\n' */
+  size_t text_len;
+
+  char* out;                  /* lines to write on the output */
+  size_t out_len;
+  char* err;                  /* error messages for stderr */
+  size_t err_len;
+
+  unsigned long puzzles;
+  unsigned long unsolvable;
+  unsigned long malformed;
+} job_t;
+
+typedef struct totals {
+  unsigned long puzzles;
+  unsigned long unsolvable;
+  unsigned long malformed;
+} totals_t;
+
+/*
+ * Work-stealing deque: its owner pops from the tail while the other
+ * workers steal from the head.
+ */
+typedef struct deque {
+  pthread_mutex_t lock;
+  job_t** jobs;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+} deque_t;
+
+typedef struct pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;    /* a job was queued or the input ended */
+  pthread_cond_t ready;   /* a job was solved */
+  pthread_cond_t space;   /* a job was written */
+
+  deque_t* deques;
+  const batch_options_t* options;
+  size_t workers;
+
+  size_t pending;         /* jobs queued and not yet taken */
+  size_t inflight;        /* jobs read and not yet written */
+  size_t max_inflight;
+  bool eof;
+  unsigned long read;     /* number of jobs read */
+
+  job_t** solved;         /* reorder buffer indexed by seq */
+  FILE* out;
+  totals_t totals;
+} pool_t;
+
+typedef struct worker {
+  pool_t* pool;
+  size_t id;
+} worker_t;
+
+static double
+elapsed_seconds (const struct timespec* start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start->tv_sec)
+	  + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void
+batch_out_of_memory (void)
+{
+  fprintf (stderr, "%s: error: out of memory!\n", exec_name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+job_free (job_t* job)
+{
+  if (job == NULL)
+    return;
+  free (job->text);
+  free (job->out);
+  free (job->err);
+  free (job);
+}
+
+/*
+ * Reads up to BATCH_CHUNK lines of `in` in a new job, returns NULL at
+ * the end of the input. `line_number` is the number of lines read so
+ * far and gets updated.
+ */
+static job_t*
+job_read (FILE* in, unsigned long seq, unsigned long* line_number)
+{
+  char* line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  FILE* text;
+
+  job_t* job = calloc (1, sizeof (job_t));
+  if (job == NULL)
+    batch_out_of_memory ();
+  job->seq = seq;
+  job->first_line = *line_number + 1;
+
+  text = open_memstream (&job->text, &job->text_len);
+  if (text == NULL)
+    batch_out_of_memory ();
+
+  for (int n = 0; n < BATCH_CHUNK; n++)
+    {
+      if ((len = getline (&line, &capacity, in)) == -1)
+	break;
+      (*line_number)++;
+      fwrite (line, 1, len, text);
+      if (line[len - 1] != '\n')
+	fputc ('\n', text);
+    }
+  free (line);
+  fclose (text);
+
+  if (job->text_len == 0)
+    {
+      job_free (job);
+      return (NULL);
+    }
+  return (job);
+}
+
+static sudoku_ctx_t*
+batch_ctx_new (const batch_options_t* options)
+{
+  sudoku_ctx_t* ctx = sudoku_ctx_new ();
+
+  if (ctx == NULL)
+    batch_out_of_memory ();
+  sudoku_set_engine (ctx, options->engine);
+  sudoku_set_branch (ctx, options->branch);
+  sudoku_set_restarts (ctx, options->restarts);
+  sudoku_set_learning (ctx, options->learning);
+  sudoku_set_probing (ctx, options->probes);
+  sudoku_set_hidden_sets (ctx, options->hidden_sets);
+  sudoku_set_fish (ctx, options->fish);
+  return (ctx);
+}
+
+/*
+ * Adds the counters of a solver to the ones of the batch, if it
+ * wants them
+ */
+static void
+batch_ctx_free (sudoku_ctx_t* ctx, const batch_options_t* options)
+{
+  if (options->stats != NULL)
+    sudoku_add_stats (options->stats, &ctx->stats);
+  sudoku_ctx_free (ctx);
+}
+
+/*
+ * A puzzle line of a job, the 9x9 grids are kept aside to be solved
+ * in lockstep once the whole job is parsed
+ */
+typedef struct puzzle {
+  const char* line;
+  size_t len;
+  sudoku_status_t status;
+  pset_t* grid;               /* 9x9 grid, or NULL */
+  char* solution;             /* solved grid of another size, or NULL */
+  unsigned long solutions;    /* when counting */
+  bool echo;                  /* comment or blank line, written as is */
+} puzzle_t;
+
+/*
+ * Solves the 9x9 grids of the `count` puzzles LOCKSTEP_LANES at a time
+ */
+static void
+puzzles_lockstep (sudoku_ctx_t* ctx, puzzle_t puzzles[], size_t count)
+{
+  pset_t* grids[LOCKSTEP_LANES];
+  sudoku_status_t status[LOCKSTEP_LANES];
+  puzzle_t* lanes[LOCKSTEP_LANES];
+  size_t n = 0;
+
+  for (size_t k = 0; k <= count; k++)
+    {
+      if (k < count && puzzles[k].grid != NULL)
+	{
+	  lanes[n] = &puzzles[k];
+	  grids[n] = puzzles[k].grid;
+	  n++;
+	}
+      if (n == LOCKSTEP_LANES || (k == count && n > 0))
+	{
+	  lockstep_solve (ctx, grids, status, n);
+	  for (size_t l = 0; l < n; l++)
+	    lanes[l]->status = status[l];
+	  n = 0;
+	}
+    }
+}
+
+/*
+ * Solves the puzzles of the job, the 9x9 grids go through the lockstep
+ * propagation only with the default engine, without counters and
+ * without a portfolio
+ */
+static void
+job_solve (sudoku_ctx_t* ctx, job_t* job, const batch_options_t* options)
+{
+  bool lockstep = (options->engine == SUDOKU_ENGINE_HEURISTICS
+		   && options->stats == NULL && options->portfolio <= 1);
+  char solved[MAX_GRID_SIZE * MAX_GRID_SIZE + 1];
+  unsigned long line_number = job->first_line;
+  puzzle_t puzzles[BATCH_CHUNK];
+  pset_t grids[BATCH_CHUNK][81];
+  size_t count = 0;
+  FILE* out = open_memstream (&job->out, &job->out_len);
+  FILE* err = open_memstream (&job->err, &job->err_len);
+
+  if (out == NULL || err == NULL)
+    batch_out_of_memory ();
+
+  for (char* line = job->text; line < job->text + job->text_len;
+       line_number++)
+    {
+      /* memchr, as a line may hold a NUL byte; every line ends with '\n' */
+      char* end = memchr (line, '\n', job->text + job->text_len - line);
+      size_t len = end - line + 1;
+      puzzle_t* puzzle = &puzzles[count];
+
+      puzzle->line = line;
+      puzzle->len = len;
+      puzzle->grid = NULL;
+      puzzle->solution = NULL;
+      line = end + 1;
+      count++;
+      puzzle->echo = (puzzle->line[0] == '#' || puzzle->line[0] == '\n'
+		      || puzzle->line[0] == '\r');
+      if (puzzle->echo)
+	continue;
+      job->puzzles++;
+
+      puzzle->status = sudoku_parse_line (ctx, puzzle->line, len);
+
+      if (puzzle->status == SUDOKU_ENOMEM)
+	batch_out_of_memory ();
+      if (puzzle->status != SUDOKU_OK)
+	{
+	  fprintf (err, "%s: error: line %lu is malformed: %s\n",
+		   exec_name, line_number, sudoku_error (ctx));
+	  job->malformed++;
+	  continue;
+	}
+
+      if (options->count)
+	{
+	  puzzle->status = sudoku_count (ctx, options->count_limit,
+					 &puzzle->solutions);
+	  continue;
+	}
+
+      if (lockstep && sudoku_grid_size (ctx) == 9)
+	{
+	  puzzle->grid = grids[count - 1];
+	  memcpy (puzzle->grid, ctx->grid, sizeof (grids[0]));
+	  continue;
+	}
+
+      puzzle->status = sudoku_solve_portfolio (ctx, options->portfolio);
+      if (puzzle->status == SUDOKU_OK)
+	{
+	  sudoku_to_line (ctx, solved);
+	  if ((puzzle->solution = strdup (solved)) == NULL)
+	    batch_out_of_memory ();
+	}
+    }
+
+  puzzles_lockstep (ctx, puzzles, count);
+
+  for (size_t k = 0; k < count; k++)
+    {
+      puzzle_t* puzzle = &puzzles[k];
+
+      if (puzzle->echo)
+	{
+	  fwrite (puzzle->line, 1, puzzle->len, out);
+	  continue;
+	}
+      switch (puzzle->status)
+	{
+	case SUDOKU_OK:
+	  if (options->count)
+	    {
+	      if (puzzle->solutions == 0)
+		job->unsolvable++;
+	      fprintf (out, "%lu\n", puzzle->solutions);
+	    }
+	  else if (puzzle->grid != NULL)
+	    {
+	      grid_to_line (ctx, puzzle->grid, solved);
+	      fprintf (out, "%s\n", solved);
+	    }
+	  else
+	    fprintf (out, "%s\n", puzzle->solution);
+	  break;
+	case SUDOKU_UNSOLVABLE:
+	  job->unsolvable++;
+	  fwrite (puzzle->line, 1, puzzle->len, out);
+	  break;
+	case SUDOKU_ESIZE:
+	case SUDOKU_EPARSE:
+	  fputc ('\n', out);
+	  break;
+	default:
+	  batch_out_of_memory ();
+	}
+      free (puzzle->solution);
+    }
+  fclose (out);
+  fclose (err);
+}
+
+static void
+job_write (job_t* job, FILE* out, totals_t* totals)
+{
+  fwrite (job->err, 1, job->err_len, stderr);
+  fwrite (job->out, 1, job->out_len, out);
+  totals->puzzles    += job->puzzles;
+  totals->unsolvable += job->unsolvable;
+  totals->malformed  += job->malformed;
+}
+
+static void
+deque_push (deque_t* deque, job_t* job)
+{
+  pthread_mutex_lock (&deque->lock);
+  deque->jobs[deque->tail % deque->capacity] = job;
+  deque->tail++;
+  pthread_mutex_unlock (&deque->lock);
+}
+
+/*
+ * Takes a job from the tail of the deque if `own` is true or steals
+ * one from its head otherwise, returns NULL if the deque is empty
+ */
+static job_t*
+deque_take (deque_t* deque, bool own)
+{
+  job_t* job = NULL;
+
+  pthread_mutex_lock (&deque->lock);
+  if (deque->head != deque->tail)
+    {
+      if (own)
+	{
+	  deque->tail--;
+	  job = deque->jobs[deque->tail % deque->capacity];
+	}
+      else
+	{
+	  job = deque->jobs[deque->head % deque->capacity];
+	  deque->head++;
+	}
+    }
+  pthread_mutex_unlock (&deque->lock);
+  return (job);
+}
+
+static void*
+worker_run (void* arg)
+{
+  worker_t* self = arg;
+  pool_t* pool = self->pool;
+  sudoku_ctx_t* ctx = batch_ctx_new (pool->options);
+
+  for (;;)
+    {
+      job_t* job = NULL;
+
+      pthread_mutex_lock (&pool->lock);
+      while (pool->pending == 0 && !pool->eof)
+	pthread_cond_wait (&pool->work, &pool->lock);
+      if (pool->pending == 0)
+	{
+	  pthread_mutex_unlock (&pool->lock);
+	  break;
+	}
+      /*
+       * Taking one from `pending` reserves a job for this worker, it
+       * is then found either in its own deque or in another one.
+       */
+      pool->pending--;
+      pthread_mutex_unlock (&pool->lock);
+
+      for (size_t k = 0; job == NULL; k++)
+	job = deque_take (&pool->deques[(self->id + k) % pool->workers],
+			  k % pool->workers == 0);
+
+      job_solve (ctx, job, pool->options);
+
+      pthread_mutex_lock (&pool->lock);
+      pool->solved[job->seq % pool->max_inflight] = job;
+      pthread_cond_signal (&pool->ready);
+      pthread_mutex_unlock (&pool->lock);
+    }
+
+  pthread_mutex_lock (&pool->lock);
+  batch_ctx_free (ctx, pool->options);
+  pthread_mutex_unlock (&pool->lock);
+  return (NULL);
+}
+
+static void*
+writer_run (void* arg)
+{
+  pool_t* pool = arg;
+
+  for (unsigned long next = 0;; next++)
+    {
+      job_t* job;
+
+      pthread_mutex_lock (&pool->lock);
+      while ((job = pool->solved[next % pool->max_inflight]) == NULL
+	     && !(pool->eof && next == pool->read))
+	pthread_cond_wait (&pool->ready, &pool->lock);
+      if (job == NULL)
+	{
+	  pthread_mutex_unlock (&pool->lock);
+	  break;
+	}
+      pool->solved[next % pool->max_inflight] = NULL;
+      pthread_mutex_unlock (&pool->lock);
+
+      job_write (job, pool->out, &pool->totals);
+      job_free (job);
+
+      pthread_mutex_lock (&pool->lock);
+      pool->inflight--;
+      pthread_cond_signal (&pool->space);
+      pthread_mutex_unlock (&pool->lock);
+    }
+  return (NULL);
+}
+
+/*
+ * Reads the input in the calling thread and hands the jobs out to
+ * the solver threads of `options`, a writer thread puts the results
+ * back in the input order. At most `max_inflight` jobs are alive at any time
+ * so the reader blocks when the solvers or the writer fall behind.
+ * Returns false, without reading anything, if a thread could not be
+ * created.
+ */
+static bool
+batch_solve_parallel (FILE* in, FILE* out, const batch_options_t* options,
+		      totals_t* totals)
+{
+  size_t workers = options->workers;
+  size_t started = 0;
+  bool writing = false;
+  pool_t pool;
+  pthread_t writer;
+  pthread_t threads[workers];
+  worker_t args[workers];
+  unsigned long line_number = 0;
+  job_t* job;
+
+  memset (&pool, 0, sizeof (pool));
+  pthread_mutex_init (&pool.lock, NULL);
+  pthread_cond_init (&pool.work, NULL);
+  pthread_cond_init (&pool.ready, NULL);
+  pthread_cond_init (&pool.space, NULL);
+  pool.workers = workers;
+  pool.max_inflight = workers * BATCH_INFLIGHT_PER_WORKER;
+  pool.out = out;
+  pool.options = options;
+
+  pool.solved = calloc (pool.max_inflight, sizeof (job_t*));
+  pool.deques = calloc (workers, sizeof (deque_t));
+  if (pool.solved == NULL || pool.deques == NULL)
+    batch_out_of_memory ();
+  for (size_t i = 0; i < workers; i++)
+    {
+      pthread_mutex_init (&pool.deques[i].lock, NULL);
+      pool.deques[i].capacity = pool.max_inflight;
+      pool.deques[i].jobs = calloc (pool.max_inflight, sizeof (job_t*));
+      if (pool.deques[i].jobs == NULL)
+	batch_out_of_memory ();
+    }
+
+  for (; started < workers; started++)
+    {
+      args[started].pool = &pool;
+      args[started].id = started;
+      if (pthread_create (&threads[started], NULL, worker_run,
+			  &args[started]) != 0)
+	break;
+    }
+  if (started == workers)
+    writing = (pthread_create (&writer, NULL, writer_run, &pool) == 0);
+
+  /*
+   * The threads already started see the end of an empty input and
+   * stop
+   */
+  if (!writing)
+    {
+      fprintf (stderr, "%s: error: cannot create the threads\n", exec_name);
+      pthread_mutex_lock (&pool.lock);
+      pool.eof = true;
+      pthread_cond_broadcast (&pool.work);
+      pthread_mutex_unlock (&pool.lock);
+    }
+
+  while (writing)
+    {
+      pthread_mutex_lock (&pool.lock);
+      while (pool.inflight == pool.max_inflight)
+	pthread_cond_wait (&pool.space, &pool.lock);
+      pthread_mutex_unlock (&pool.lock);
+
+      job = job_read (in, pool.read, &line_number);
+
+      pthread_mutex_lock (&pool.lock);
+      if (job == NULL)
+	{
+	  pool.eof = true;
+	  pthread_cond_broadcast (&pool.work);
+	  pthread_cond_signal (&pool.ready);
+	  pthread_mutex_unlock (&pool.lock);
+	  break;
+	}
+      pool.inflight++;
+      pool.read++;
+      pthread_mutex_unlock (&pool.lock);
+
+      deque_push (&pool.deques[job->seq % workers], job);
+
+      pthread_mutex_lock (&pool.lock);
+      pool.pending++;
+      pthread_cond_signal (&pool.work);
+      pthread_mutex_unlock (&pool.lock);
+    }
+
+  for (size_t i = 0; i < started; i++)
+    pthread_join (threads[i], NULL);
+  if (writing)
+    pthread_join (writer, NULL);
+
+  *totals = pool.totals;
+
+  for (size_t i = 0; i < workers; i++)
+    {
+      pthread_mutex_destroy (&pool.deques[i].lock);
+      free (pool.deques[i].jobs);
+    }
+  free (pool.deques);
+  free (pool.solved);
+  pthread_cond_destroy (&pool.space);
+  pthread_cond_destroy (&pool.ready);
+  pthread_cond_destroy (&pool.work);
+  pthread_mutex_destroy (&pool.lock);
+  return (writing);
+}
+
+bool
+batch_solve (FILE* in, FILE* out, const batch_options_t* options)
+{
+  totals_t totals = {0, 0, 0};
+  unsigned long line_number = 0;
+  struct timespec start;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  if (options->workers > 1)
+    {
+      if (!batch_solve_parallel (in, out, options, &totals))
+	return (false);
+    }
+  else
+    {
+      sudoku_ctx_t* ctx = batch_ctx_new (options);
+      job_t* job;
+
+      for (unsigned long seq = 0;
+	   (job = job_read (in, seq, &line_number)) != NULL; seq++)
+	{
+	  job_solve (ctx, job, options);
+	  job_write (job, out, &totals);
+	  job_free (job);
+	}
+      batch_ctx_free (ctx, options);
+    }
+
+  double seconds = elapsed_seconds (&start);
+
+  fprintf (stderr,
+	   "%lu puzzles (%lu unsolvable, %lu malformed) in %.3f s, "
+	   "%.1f puzzles/sec\n",
+	   totals.puzzles, totals.unsolvable, totals.malformed, seconds,
+	   seconds > 0 ? totals.puzzles / seconds : 0.0);
+
+  return (totals.malformed == 0);
+}
+
+/*
+ * Generation of many grids: the grids are numbered and handed out to
+ * the workers BATCH_CHUNK at a time, the calling thread writes the
+ * chunks in order. At most `window` chunks are alive at any time.
+ */
+typedef struct generator {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;   /* a chunk was generated */
+  pthread_cond_t space;   /* a chunk was written */
+
+  const batch_options_t* options;
+  unsigned long chunks;   /* number of chunks to generate */
+  unsigned long taken;    /* chunks handed out so far */
+  unsigned long written;  /* chunks written so far */
+  size_t window;
+  bool stop;              /* no more chunks are handed out */
+  char** text;            /* generated chunks indexed by chunk % window */
+  size_t* text_len;
+} generator_t;
+
+/*
+ * Seed of the nth grid, mixed so that the grids of neighbouring seeds
+ * don't share their random numbers
+ */
+static uint64_t
+grid_seed (uint64_t seed, unsigned long n)
+{
+  uint64_t z = seed ^ (n * 0xd1342543de82ef95);
+
+  z = (z ^ (z >> 32)) * 0xd6e8feb86659fd93;
+  z = (z ^ (z >> 32)) * 0xd6e8feb86659fd93;
+  return (z ^ (z >> 32));
+}
+
+/*
+ * Generates the grids of the chunk `chunk` in a new string
+ */
+static void
+chunk_generate (sudoku_ctx_t* ctx, const batch_options_t* options,
+		unsigned long chunk, char** text, size_t* text_len)
+{
+  char line[MAX_GRID_SIZE * MAX_GRID_SIZE + 1];
+  unsigned long first = chunk * BATCH_CHUNK;
+  FILE* out = open_memstream (text, text_len);
+
+  if (out == NULL)
+    batch_out_of_memory ();
+
+  for (unsigned long n = first;
+       n < first + BATCH_CHUNK && n < options->puzzles; n++)
+    {
+      sudoku_set_seed (ctx, grid_seed (options->seed, n));
+      if (sudoku_generate (ctx, options->size) != SUDOKU_OK)
+	batch_out_of_memory ();
+      sudoku_to_line (ctx, line);
+      fprintf (out, "%s\n", line);
+    }
+  fclose (out);
+}
+
+static void*
+generator_run (void* arg)
+{
+  generator_t* gen = arg;
+  sudoku_ctx_t* ctx = batch_ctx_new (gen->options);
+
+  sudoku_set_strict (ctx, gen->options->strict);
+  for (;;)
+    {
+      unsigned long chunk;
+      char* text;
+      size_t text_len;
+
+      pthread_mutex_lock (&gen->lock);
+      while (gen->taken < gen->chunks && !gen->stop
+	     && gen->taken >= gen->written + gen->window)
+	pthread_cond_wait (&gen->space, &gen->lock);
+      if (gen->taken == gen->chunks || gen->stop)
+	{
+	  pthread_mutex_unlock (&gen->lock);
+	  break;
+	}
+      chunk = gen->taken++;
+      pthread_mutex_unlock (&gen->lock);
+
+      chunk_generate (ctx, gen->options, chunk, &text, &text_len);
+
+      pthread_mutex_lock (&gen->lock);
+      gen->text[chunk % gen->window] = text;
+      gen->text_len[chunk % gen->window] = text_len;
+      pthread_cond_signal (&gen->ready);
+      pthread_mutex_unlock (&gen->lock);
+    }
+
+  pthread_mutex_lock (&gen->lock);
+  batch_ctx_free (ctx, gen->options);
+  pthread_mutex_unlock (&gen->lock);
+  return (NULL);
+}
+
+bool
+batch_generate (FILE* out, const batch_options_t* options)
+{
+  size_t workers = options->workers;
+  size_t started = 0;
+  pthread_t threads[workers];
+  generator_t gen;
+  struct timespec start;
+
+  if (!valid_grid_size (options->size))
+    {
+      fprintf (stderr, "%s: error: wrong grid size: %zu\n", exec_name,
+	       options->size);
+      return (false);
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  memset (&gen, 0, sizeof (gen));
+  pthread_mutex_init (&gen.lock, NULL);
+  pthread_cond_init (&gen.ready, NULL);
+  pthread_cond_init (&gen.space, NULL);
+  gen.options = options;
+  gen.chunks = (options->puzzles + BATCH_CHUNK - 1) / BATCH_CHUNK;
+  gen.window = workers * BATCH_INFLIGHT_PER_WORKER;
+  gen.text = calloc (gen.window, sizeof (char*));
+  gen.text_len = calloc (gen.window, sizeof (size_t));
+  if (gen.text == NULL || gen.text_len == NULL)
+    batch_out_of_memory ();
+
+  for (; started < workers; started++)
+    if (pthread_create (&threads[started], NULL, generator_run, &gen) != 0)
+      break;
+
+  /* The threads already started stop after their current chunk */
+  if (started < workers)
+    {
+      fprintf (stderr, "%s: error: cannot create the threads\n", exec_name);
+      pthread_mutex_lock (&gen.lock);
+      gen.stop = true;
+      pthread_cond_broadcast (&gen.space);
+      pthread_mutex_unlock (&gen.lock);
+    }
+
+  for (unsigned long chunk = 0; chunk < gen.chunks && !gen.stop; chunk++)
+    {
+      char* text;
+      size_t text_len;
+
+      pthread_mutex_lock (&gen.lock);
+      while ((text = gen.text[chunk % gen.window]) == NULL)
+	pthread_cond_wait (&gen.ready, &gen.lock);
+      text_len = gen.text_len[chunk % gen.window];
+      gen.text[chunk % gen.window] = NULL;
+      pthread_mutex_unlock (&gen.lock);
+
+      fwrite (text, 1, text_len, out);
+      free (text);
+
+      pthread_mutex_lock (&gen.lock);
+      gen.written++;
+      pthread_cond_broadcast (&gen.space);
+      pthread_mutex_unlock (&gen.lock);
+    }
+
+  for (size_t i = 0; i < started; i++)
+    pthread_join (threads[i], NULL);
+
+  double seconds = elapsed_seconds (&start);
+
+  if (!gen.stop)
+    fprintf (stderr, "%lu puzzles generated in %.3f s, %.1f puzzles/sec\n",
+	     options->puzzles, seconds,
+	     seconds > 0 ? options->puzzles / seconds : 0.0);
+
+  for (size_t k = 0; k < gen.window; k++)
+    free (gen.text[k]);
+  free (gen.text);
+  free (gen.text_len);
+  pthread_cond_destroy (&gen.space);
+  pthread_cond_destroy (&gen.ready);
+  pthread_mutex_destroy (&gen.lock);
+  return (!gen.stop);
+}
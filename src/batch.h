@@ -0,0 +1,64 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+ * How the grids of a batch are solved
+ */
+typedef struct batch_options {
+  size_t workers;          /* number of solver threads */
+  sudoku_engine_t engine;  /* search of the solvers */
+  sudoku_branch_t branch;  /* branching strategy of their search */
+  unsigned long restarts;  /* dead ends before their first restart */
+  bool learning;           /* backjump and learn nogoods */
+  size_t probes;           /* cells probed before each choice */
+  bool hidden_sets;        /* look for hidden pairs and triples */
+  bool fish;               /* look for X-Wings and Swordfish */
+  size_t portfolio;        /* searches raced on each grid, one if 0 */
+  sudoku_stats_t* stats;   /* gets the sum of their counters, or NULL */
+  bool count;              /* count the solutions instead of solving */
+  unsigned long count_limit;  /* stop counting there, unless 0 */
+
+  size_t size;             /* size of the grids to generate */
+  unsigned long puzzles;   /* number of grids to generate */
+  bool strict;             /* generate grids with only one solution */
+  uint64_t seed;           /* seed of the generated grids */
+} batch_options_t;
+
+/*
+ * Solves every grid of the stream `in`, one grid per line in the
+ * format read by `grid_parse_line`, and writes one line per grid on
+ * `out`: the solved grid, the unchanged line if the grid could not be
+ * solved or an empty line if the line is malformed. When counting, the
+ * line of a grid holds its number of solutions instead. Empty lines and
+ * lines starting with '#' are written back unchanged, so that the
+ * output matches the input line for line. A summary with the number of
+ * puzzles per second is written on stderr at the end.
+ *
+ * With the default engine, the 9x9 grids of a chunk of lines are
+ * solved LOCKSTEP_LANES at a time, see lockstep.h, unless `stats`
+ * isn't NULL: the grids are then all solved one by one so that the
+ * counters of the solvers see all their work. They are also solved one
+ * by one when `portfolio` races several searches on each of them.
+ *
+ * With more than one worker the grids are spread over that many
+ * threads, the lines are still written in the input order.
+ *
+ * Returns false if at least one line was malformed, or if the threads
+ * could not be created.
+ */
+bool batch_solve (FILE* in, FILE* out, const batch_options_t* options);
+
+/*
+ * Generates `puzzles` grids of size `size` with the workers of
+ * `options` and writes them on `out`, one per line in the format read
+ * by `grid_parse_line`. The nth grid only depends on `seed` and n, so
+ * the output doesn't depend on the number of workers. A summary is
+ * written on stderr at the end.
+ *
+ * Returns false if the size isn't valid, or if the threads could not
+ * be created: the ones already started are then stopped after their
+ * current chunk and nothing is written.
+ */
+bool batch_generate (FILE* out, const batch_options_t* options);
+
+#endif /* BATCH_H */
@@ -0,0 +1,436 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <getopt.h>
+#include <libgen.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libsudoku.h>
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "heuristics.h"
+
+/*
+ * Benchmark of the solver: solves the grids of a file, one per line,
+ * and sets of generated grids one at a time, and writes one JSON
+ * object per set on stdout so that the results of two builds can be
+ * compared. The propagation of 64x64 grids is also measured on its
+ * own.
+ */
+
+#define DEFAULT_FILE "../test/sudoku17"
+#define DEFAULT_COUNT 50
+#define DEFAULT_SEED 1
+
+/*
+ * The generated sets, with the share of their cells left empty, which
+ * keeps the hardest of them solvable in a fraction of a second
+ */
+static const struct {
+  size_t size;
+  double empty;
+} generated[] = {
+  {16, 0.55},
+  {25, 0.45},
+  {36, 0.40},
+};
+
+/*
+ * The microbenchmark of the propagation: its grid size, the share of
+ * the cells left empty and the number of times each grid is propagated
+ */
+#define PROPAGATION_SIZE 64
+#define PROPAGATION_EMPTY 0.50
+#define PROPAGATION_RUNS 10
+
+static char* exec_name;
+static sudoku_engine_t engine = SUDOKU_ENGINE_HEURISTICS;
+static sudoku_branch_t branch = SUDOKU_BRANCH_MRV;
+static unsigned long restarts = 0;
+static bool learning = false;
+static size_t probes = 0;
+static bool hidden_sets = false;
+static bool fish = false;
+
+typedef struct bench {
+  const char* name;
+  size_t size;
+  size_t puzzles;
+  size_t unsolvable;
+  double* latencies;     /* of every grid, in seconds */
+  size_t capacity;
+  double seconds;
+  sudoku_stats_t stats;
+} bench_t;
+
+static void
+bench_out_of_memory (void)
+{
+  fprintf (stderr, "%s: error: out of memory!\n", exec_name);
+  exit (EXIT_FAILURE);
+}
+
+static double
+elapsed_seconds (const struct timespec* start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start->tv_sec)
+	  + (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+/*
+ * Solves the grid written on `line` and records the time it took,
+ * returns false if the line is malformed
+ */
+static bool
+bench_line (bench_t* bench, sudoku_ctx_t* ctx, const char* line, size_t len)
+{
+  struct timespec start;
+  sudoku_status_t status;
+
+  if (sudoku_parse_line (ctx, line, len) != SUDOKU_OK)
+    return (false);
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  status = sudoku_solve (ctx);
+  double seconds = elapsed_seconds (&start);
+
+  if (status == SUDOKU_ENOMEM)
+    bench_out_of_memory ();
+  if (status == SUDOKU_UNSOLVABLE)
+    bench->unsolvable++;
+
+  if (bench->puzzles == bench->capacity)
+    {
+      bench->capacity = bench->capacity < 64 ? 64 : 2 * bench->capacity;
+      bench->latencies = realloc (bench->latencies,
+				  bench->capacity * sizeof (double));
+      if (bench->latencies == NULL)
+	bench_out_of_memory ();
+    }
+  bench->latencies[bench->puzzles++] = seconds;
+  bench->seconds += seconds;
+  if (bench->size == 0)
+    bench->size = sudoku_grid_size (ctx);
+  return (true);
+}
+
+static int
+compare_doubles (const void* a, const void* b)
+{
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+
+  return ((x > y) - (x < y));
+}
+
+/*
+ * Latency below which a share `p` of the grids were solved
+ */
+static double
+percentile (const bench_t* bench, double p)
+{
+  size_t k = p * bench->puzzles;
+
+  return (bench->latencies[k < bench->puzzles ? k : bench->puzzles - 1]);
+}
+
+static void
+bench_report (bench_t* bench)
+{
+  if (bench->puzzles == 0)
+    return;
+
+  qsort (bench->latencies, bench->puzzles, sizeof (double),
+	 &compare_doubles);
+  printf ("{\"set\": \"%s\", \"engine\": \"%s\", \"branch\": \"%s\", "
+	  "\"restarts\": %lu, \"learning\": %s, \"probes\": %zu, "
+	  "\"hidden_sets\": %s, \"fish\": %s, "
+	  "\"size\": %zu, \"puzzles\": %zu, "
+	  "\"unsolvable\": %zu, \"seconds\": %.6f, "
+	  "\"puzzles_per_sec\": %.1f, "
+	  "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}, "
+	  "\"decisions\": %lu, \"backtracks\": %lu}\n",
+	  bench->name, sudoku_engine_name (engine),
+	  sudoku_branch_name (branch), restarts, learning ? "true" : "false",
+	  probes, hidden_sets ? "true" : "false", fish ? "true" : "false",
+	  bench->size,
+	  bench->puzzles, bench->unsolvable,
+	  bench->seconds,
+	  bench->seconds > 0 ? bench->puzzles / bench->seconds : 0.0,
+	  percentile (bench, 0.50) * 1e6, percentile (bench, 0.99) * 1e6,
+	  bench->latencies[bench->puzzles - 1] * 1e6,
+	  bench->stats.decisions, bench->stats.backtracks);
+  fflush (stdout);
+  free (bench->latencies);
+}
+
+static void
+bench_file (sudoku_ctx_t* ctx, const char* path)
+{
+  bench_t bench = {0};
+  char* line = NULL;
+  size_t capacity = 0;
+  ssize_t len;
+  FILE* in = fopen (path, "r");
+
+  if (in == NULL)
+    {
+      fprintf (stderr, "%s: error: cannot open file: %s\n", exec_name, path);
+      exit (EXIT_FAILURE);
+    }
+
+  bench.name = path;
+  sudoku_reset_stats (ctx);
+  while ((len = getline (&line, &capacity, in)) != -1)
+    {
+      if (line[0] == '#' || line[0] == '\n')
+	continue;
+      if (!bench_line (&bench, ctx, line, len))
+	fprintf (stderr, "%s: error: %s: %s\n", exec_name, path,
+		 sudoku_error (ctx));
+    }
+  sudoku_get_stats (ctx, &bench.stats);
+  free (line);
+  fclose (in);
+
+  bench_report (&bench);
+}
+
+/*
+ * Writes on `line` a random grid of size `size` with a share `empty`
+ * of its cells left empty: a solved grid from the generator of the
+ * library, blanked with the random numbers of the context
+ */
+static void
+random_line (sudoku_ctx_t* ctx, size_t size, double empty, char line[])
+{
+  if (grid_resize (ctx, size) != SUDOKU_OK)
+    bench_out_of_memory ();
+
+  grid_fill (ctx, ctx->grid);
+  for (size_t c = 0; c < size * size; c++)
+    if (random_below (ctx, 1 << 20) < empty * (1 << 20))
+      ctx->grid[c] = pset_full (size);
+  sudoku_to_line (ctx, line);
+}
+
+static void
+bench_generated (sudoku_ctx_t* ctx, size_t size, double empty,
+		 size_t count, uint64_t seed)
+{
+  char name[32];
+  char line[size * size + 1];
+  bench_t bench = {0};
+
+  sudoku_set_seed (ctx, seed);
+  snprintf (name, sizeof (name), "generated-%zu", size);
+  bench.name = name;
+  sudoku_reset_stats (ctx);
+  for (size_t n = 0; n < count; n++)
+    {
+      random_line (ctx, size, empty, line);
+      bench_line (&bench, ctx, line, size * size);
+    }
+  sudoku_get_stats (ctx, &bench.stats);
+
+  bench_report (&bench);
+}
+
+/*
+ * Propagates `count` generated grids of size `size` from scratch,
+ * PROPAGATION_RUNS times each, without any search. Every run checks
+ * the consistency of all the units of the grid and runs the stages of
+ * the propagation on them until they are stuck.
+ */
+static void
+bench_propagation (sudoku_ctx_t* ctx, size_t size, double empty,
+		   size_t count, uint64_t seed)
+{
+  char line[size * size + 1];
+  size_t runs = 0;
+  double seconds = 0;
+  sudoku_stats_t stats;
+
+  sudoku_set_seed (ctx, seed);
+  sudoku_reset_stats (ctx);
+  for (size_t n = 0; n < count; n++)
+    {
+      random_line (ctx, size, empty, line);
+      if (sudoku_parse_line (ctx, line, size * size) != SUDOKU_OK)
+	continue;
+
+      pset_t* grid = grid_alloc (ctx);
+
+      if (grid == NULL)
+	bench_out_of_memory ();
+      for (size_t r = 0; r < PROPAGATION_RUNS; r++)
+	{
+	  struct timespec start;
+
+	  memcpy (grid, ctx->grid, size * size * sizeof (pset_t));
+	  clock_gettime (CLOCK_MONOTONIC, &start);
+	  grid_heuristics (ctx, grid);
+	  seconds += elapsed_seconds (&start);
+	  runs++;
+	}
+      grid_free (grid);
+    }
+  sudoku_get_stats (ctx, &stats);
+  if (runs == 0)
+    return;
+
+  printf ("{\"set\": \"propagation-%zu\", \"size\": %zu, \"runs\": %zu, "
+	  "\"seconds\": %.6f, \"propagation_us\": %.1f, "
+	  "\"passes\": %lu}\n",
+	  size, size, runs, seconds, seconds / runs * 1e6, stats.passes);
+  fflush (stdout);
+}
+
+static void
+usage (int status)
+{
+  if (status == EXIT_SUCCESS)
+    printf ("Usage: %s [OPTION] [FILE]\n"
+	    "Measure the solver on the grids of FILE, one per line (by\n"
+	    "default %s), and on generated 16x16, 25x25 and 36x36 grids,\n"
+	    "then the propagation alone on generated 64x64 grids.\n"
+	    "Writes one JSON object per set of grids.\n"
+	    "\n"
+	    "  -n, --count=N   generate N grids of each size (by default %d,\n"
+	    "                  0 to skip them)\n"
+	    "  -s, --seed=N    seed of the generated grids (by default %d)\n"
+	    "  -e, --engine=E  solve with the engine E: heuristics (the\n"
+	    "                  default) or dlx\n"
+	    "  -b, --branch=B  branch with the strategy B: mrv (the\n"
+	    "                  default), degree, lcv or peers\n"
+	    "  -r, --restarts=N restart after N dead ends, then after N\n"
+	    "                  times the Luby sequence (by default 0, never)\n"
+	    "  -l, --learning  backjump and learn nogoods from the conflicts\n"
+	    "  -p, --probe=N   probe N cells before each choice (by default\n"
+	    "                  0, never)\n"
+	    "  -H, --hidden-sets  look for hidden pairs and triples\n"
+	    "  -f, --fish      look for X-Wings and Swordfish\n"
+	    "  -h, --help      display this help\n",
+	    basename (exec_name), DEFAULT_FILE, DEFAULT_COUNT, DEFAULT_SEED);
+  else
+    fprintf (stderr, "Try `%s --help` for more information\n",
+	     basename (exec_name));
+  exit (status);
+}
+
+int
+main (int argc, char* argv[])
+{
+  int optc;
+  long count = DEFAULT_COUNT;
+  uint64_t seed = DEFAULT_SEED;
+  sudoku_ctx_t* ctx;
+  struct option long_opts[] =
+    {
+      {"count", required_argument, 0, 'n'},
+      {"seed",  required_argument, 0, 's'},
+      {"engine", required_argument, 0, 'e'},
+      {"branch", required_argument, 0, 'b'},
+      {"restarts", required_argument, 0, 'r'},
+      {"learning", no_argument, 0, 'l'},
+      {"probe", required_argument, 0, 'p'},
+      {"hidden-sets", no_argument, 0, 'H'},
+      {"fish", no_argument, 0, 'f'},
+      {"help",  no_argument,       0, 'h'},
+      {NULL, 0, NULL, 0}
+    };
+
+  exec_name = argv[0];
+
+  while ((optc = getopt_long (argc, argv, "n:s:e:b:r:lp:Hfh", long_opts, NULL)) != -1)
+    {
+      switch (optc)
+	{
+	case 'n':
+	  count = atol (optarg);
+	  if (count < 0)
+	    {
+	      fprintf (stderr, "Wrong number of grids: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case 's':
+	  seed = strtoull (optarg, NULL, 10);
+	  break;
+
+	case 'e':
+	  if (sudoku_engine_parse (optarg, &engine) != SUDOKU_OK)
+	    {
+	      fprintf (stderr, "Unknown engine: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case 'b':
+	  if (sudoku_branch_parse (optarg, &branch) != SUDOKU_OK)
+	    {
+	      fprintf (stderr, "Unknown branching: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case 'r':
+	  restarts = strtoul (optarg, NULL, 10);
+	  break;
+
+	case 'l':
+	  learning = true;
+	  break;
+
+	case 'p':
+	  probes = strtoul (optarg, NULL, 10);
+	  break;
+
+	case 'H':
+	  hidden_sets = true;
+	  break;
+
+	case 'f':
+	  fish = true;
+	  break;
+
+	case 'h':
+	  usage (EXIT_SUCCESS);
+	  break;
+
+	default:
+	  usage (EXIT_FAILURE);
+	}
+    }
+  if (argc - optind > 1)
+    usage (EXIT_FAILURE);
+
+  ctx = sudoku_ctx_new ();
+  if (ctx == NULL)
+    bench_out_of_memory ();
+  sudoku_set_engine (ctx, engine);
+  sudoku_set_branch (ctx, branch);
+  sudoku_set_restarts (ctx, restarts);
+  sudoku_set_learning (ctx, learning);
+  sudoku_set_probing (ctx, probes);
+  sudoku_set_hidden_sets (ctx, hidden_sets);
+  sudoku_set_fish (ctx, fish);
+
+  bench_file (ctx, optind < argc ? argv[optind] : DEFAULT_FILE);
+  for (size_t k = 0; k < sizeof (generated) / sizeof (generated[0]); k++)
+    bench_generated (ctx, generated[k].size, generated[k].empty, count,
+		     seed + k);
+  bench_propagation (ctx, PROPAGATION_SIZE, PROPAGATION_EMPTY, count,
+		     seed + sizeof (generated) / sizeof (generated[0]));
+
+  sudoku_ctx_free (ctx);
+  exit (EXIT_SUCCESS);
+}
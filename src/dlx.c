@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "units.h"
+#include "dlx.h"
+
+/*
+ * The links of the exact cover problem. Node 0 is the root, nodes 1
+ * to `columns` are the headers of the columns and the nodes of the rows
+ * follow, four by four. All the arrays hold `capacity` entries.
+ */
+struct dlx {
+  size_t capacity;
+  int32_t* left;
+  int32_t* right;
+  int32_t* up;
+  int32_t* down;
+  int32_t* column;      /* header of the column of each node */
+  int32_t* candidate;   /* cell * grid_size + value of the row of a node */
+  int32_t* size;        /* number of rows left in each column */
+  int32_t* stack;       /* rows of the cover being built */
+  size_t depth;         /* number of rows on the stack */
+};
+
+void
+dlx_free (struct dlx* dlx)
+{
+  if (dlx == NULL)
+    return;
+
+  free (dlx->left);
+  free (dlx->right);
+  free (dlx->up);
+  free (dlx->down);
+  free (dlx->column);
+  free (dlx->candidate);
+  free (dlx->size);
+  free (dlx->stack);
+  free (dlx);
+}
+
+/*
+ * Makes sure the links of the context hold at least `nodes` nodes,
+ * returns false if it runs out of memory
+ */
+static bool
+dlx_reserve (sudoku_ctx_t* ctx, size_t nodes)
+{
+  struct dlx* dlx = ctx->dlx;
+
+  if (dlx == NULL)
+    {
+      dlx = ctx->dlx = calloc (1, sizeof (struct dlx));
+      if (dlx == NULL)
+	return (false);
+    }
+  if (nodes <= dlx->capacity)
+    return (true);
+
+  int32_t** arrays[] = {
+    &dlx->left, &dlx->right, &dlx->up, &dlx->down,
+    &dlx->column, &dlx->candidate, &dlx->size, &dlx->stack
+  };
+
+  for (size_t k = 0; k < sizeof (arrays) / sizeof (arrays[0]); k++)
+    {
+      int32_t* array = realloc (*arrays[k], nodes * sizeof (int32_t));
+
+      if (array == NULL)
+	return (false);
+      *arrays[k] = array;
+    }
+  dlx->capacity = nodes;
+  return (true);
+}
+
+/*
+ * Links one row per candidate of the cells of `grid`, returns false if
+ * it runs out of memory
+ */
+static bool
+dlx_build (sudoku_ctx_t* ctx, const pset_t* grid)
+{
+  const units_t* units = ctx->units;
+  size_t grid_size = ctx->grid_size;
+  size_t cells = grid_size * grid_size;
+  int32_t columns = 4 * cells;
+  size_t nodes = 1 + columns;
+
+  for (size_t c = 0; c < cells; c++)
+    nodes += 4 * pset_cardinality (grid[c]);
+  if (!dlx_reserve (ctx, nodes))
+    return (false);
+
+  struct dlx* d = ctx->dlx;
+
+  for (int32_t x = 0; x <= columns; x++)
+    {
+      d->left[x] = x - 1;
+      d->right[x] = x + 1;
+      d->up[x] = d->down[x] = x;
+      d->column[x] = x;
+      d->size[x] = 0;
+    }
+  d->left[0] = columns;
+  d->right[columns] = 0;
+  d->depth = 0;
+
+  /*
+   * Column 1 + c is the cell c, column 1 + cells + u * grid_size + v
+   * the value v in the unit u
+   */
+  int32_t x = columns + 1;
+
+  for (size_t c = 0; c < cells; c++)
+    for (size_t v = 0; v < grid_size; v++)
+      {
+	if (!(grid[c] & ((pset_t) 1 << v)))
+	  continue;
+
+	int32_t cols[4] = {
+	  1 + c,
+	  1 + cells + units->cell_units[3 * c] * grid_size + v,
+	  1 + cells + units->cell_units[3 * c + 1] * grid_size + v,
+	  1 + cells + units->cell_units[3 * c + 2] * grid_size + v
+	};
+
+	for (int k = 0; k < 4; k++)
+	  {
+	    int32_t node = x + k;
+	    int32_t col = cols[k];
+
+	    d->column[node] = col;
+	    d->candidate[node] = c * grid_size + v;
+	    d->left[node] = x + (k + 3) % 4;
+	    d->right[node] = x + (k + 1) % 4;
+	    d->up[node] = d->up[col];
+	    d->down[node] = col;
+	    d->down[d->up[col]] = node;
+	    d->up[col] = node;
+	    d->size[col]++;
+	  }
+	x += 4;
+      }
+  return (true);
+}
+
+static inline void
+dlx_cover (struct dlx* d, int32_t c)
+{
+  d->right[d->left[c]] = d->right[c];
+  d->left[d->right[c]] = d->left[c];
+  for (int32_t i = d->down[c]; i != c; i = d->down[i])
+    for (int32_t j = d->right[i]; j != i; j = d->right[j])
+      {
+	d->down[d->up[j]] = d->down[j];
+	d->up[d->down[j]] = d->up[j];
+	d->size[d->column[j]]--;
+      }
+}
+
+static inline void
+dlx_uncover (struct dlx* d, int32_t c)
+{
+  for (int32_t i = d->up[c]; i != c; i = d->up[i])
+    for (int32_t j = d->left[i]; j != i; j = d->left[j])
+      {
+	d->size[d->column[j]]++;
+	d->down[d->up[j]] = j;
+	d->up[d->down[j]] = j;
+      }
+  d->right[d->left[c]] = c;
+  d->left[d->right[c]] = c;
+}
+
+/*
+ * The column with the fewest rows left, or 0 if all are covered
+ */
+static int32_t
+dlx_choose (const struct dlx* d)
+{
+  int32_t best = 0;
+  int32_t min = INT32_MAX;
+
+  for (int32_t c = d->right[0]; c != 0; c = d->right[c])
+    if (d->size[c] < min)
+      {
+	min = d->size[c];
+	best = c;
+	if (min <= 1)
+	  break;
+      }
+  return (best);
+}
+
+/*
+ * Looks for the exact covers of the links and stops at the `limit`th
+ * one (never if `limit` is 0), leaving its rows on the stack. Returns
+ * the number of covers found, 0 if the search was stopped. Each row
+ * put in the cover counts as a decision of the context and each row
+ * taken back as a backtrack.
+ */
+static unsigned long
+dlx_search (sudoku_ctx_t* ctx, unsigned long limit)
+{
+  struct dlx* d = ctx->dlx;
+  unsigned long found = 0;
+
+  for (;;)
+    {
+      int32_t c = dlx_choose (d);
+      int32_t r = 0;           /* next row to try, 0 to backtrack */
+
+      if (search_stopped (ctx))
+	return (0);
+      if (c == 0)
+	{
+	  if (++found == limit)
+	    return (found);
+	}
+      else if (d->size[c] > 0)
+	{
+	  dlx_cover (d, c);
+	  r = d->down[c];
+	}
+
+      while (r == 0 && d->depth > 0)
+	{
+	  int32_t last = d->stack[--d->depth];
+
+	  for (int32_t j = d->left[last]; j != last; j = d->left[j])
+	    dlx_uncover (d, d->column[j]);
+	  STATS_ADD (ctx, backtracks, 1);
+	  c = d->column[last];
+	  if (d->down[last] != c)
+	    r = d->down[last];
+	  else
+	    dlx_uncover (d, c);
+	}
+      if (r == 0)
+	return (found);
+
+      d->stack[d->depth++] = r;
+      for (int32_t j = d->right[r]; j != r; j = d->right[j])
+	dlx_cover (d, d->column[j]);
+      STATS_ADD (ctx, decisions, 1);
+      STATS_MAX (ctx, max_depth, d->depth);
+    }
+}
+
+sudoku_status_t
+dlx_solve (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  if (!dlx_build (ctx, grid))
+    return (error_set (ctx, SUDOKU_ENOMEM, "out of memory!"));
+  if (dlx_search (ctx, 1) == 0)
+    return (SUDOKU_UNSOLVABLE);
+
+  struct dlx* d = ctx->dlx;
+
+  for (size_t k = 0; k < d->depth; k++)
+    {
+      int32_t candidate = d->candidate[d->stack[k]];
+
+      grid[candidate / ctx->grid_size] =
+	(pset_t) 1 << (candidate % ctx->grid_size);
+    }
+  return (SUDOKU_OK);
+}
+
+sudoku_status_t
+dlx_count (sudoku_ctx_t* ctx, const pset_t* grid, unsigned long limit,
+	   unsigned long* count)
+{
+  if (!dlx_build (ctx, grid))
+    return (error_set (ctx, SUDOKU_ENOMEM, "out of memory!"));
+
+  *count = dlx_search (ctx, limit);
+  return (SUDOKU_OK);
+}
@@ -0,0 +1,26 @@
+#ifndef DLX_H
+#define DLX_H
+
+/*
+ * Exact cover search (Knuth's Algorithm X on dancing links), an
+ * alternative to the backtracking search of grid_search. Each
+ * candidate v of a cell is a row covering four columns: the cell, and
+ * the value v in the row, the column and the block of the cell. Only
+ * the candidates left in the pset of a cell get a row.
+ *
+ * `dlx_solve` solves `grid` in place like grid_search, `dlx_count`
+ * counts its solutions up to `limit` like grid_count, leaving it
+ * unchanged. Both keep their links in the context so that they are
+ * allocated once per grid size.
+ */
+sudoku_status_t dlx_solve (sudoku_ctx_t* ctx, pset_t* grid);
+sudoku_status_t dlx_count (sudoku_ctx_t* ctx, const pset_t* grid,
+			   unsigned long limit, unsigned long* count);
+
+/*
+ * Frees the links of a context, in case of a NULL argument it does
+ * nothing
+ */
+void dlx_free (struct dlx* dlx);
+
+#endif /* DLX_H */
@@ -4,11 +4,32 @@
 /*
  * Tries solving the grid using three implemented heuristics which
  * are: 1. Locked candidates removal 2. Cross-hatching 3. Lone number
+ * along with naked sets, and hidden sets and fish if the context
+ * turns them on.
+ * If `grid` is the grid under search of the context, only the units
+ * changed since the last call are propagated.
  *
  * Returns 0 if it succeeds solving, 1 if it can't solve it, at this
  * point we have to make a guess or 2 if the grid we're trying to
- * solve is inconsistent and impossible to solve. 
+ * solve is inconsistent and impossible to solve. It runs the instance
+ * of the propagation chosen for the grid size of the context.
  */
-int grid_heuristics (pset_t** grid);
+int grid_heuristics (sudoku_ctx_t* ctx, pset_t* grid);
+
+/*
+ * Returns the instance of grid_heuristics specialized for the grids of
+ * size `grid_size`, or the generic one if there is none
+ */
+heuristics_t heuristics_kernel (size_t grid_size);
+
+/*
+ * `worklist_reset` makes `grid` the grid under search of the context
+ * and queues all of its units, so that the next call to
+ * grid_heuristics propagates the whole grid. `worklist_clear` empties
+ * the queue, which is used when backtracking to a grid on which the
+ * propagation had finished.
+ */
+void worklist_reset (sudoku_ctx_t* ctx, pset_t* grid);
+void worklist_clear (sudoku_ctx_t* ctx);
 
 #endif /* HEURISTICS_H */
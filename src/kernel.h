@@ -0,0 +1,709 @@
+/*
+ * The propagation of the heuristics, written once for all the grid
+ * sizes. heuristics.c includes this file several times: with
+ * KERNEL_SIZE and KERNEL_BLOCK set to a grid size and its block size
+ * it gives an instance where every loop bound and array size is a
+ * constant, so that the compiler can unroll the loops, and with
+ * KERNEL_SIZE set to 0 it gives the generic instance which reads the
+ * sizes from the context. The functions of an instance are suffixed by
+ * KERNEL_SUFFIX.
+ */
+
+#define KERNEL_CAT_(name, suffix) name ## _ ## suffix
+#define KERNEL_CAT(name, suffix) KERNEL_CAT_ (name, suffix)
+#define KERNEL(name) KERNEL_CAT (name, KERNEL_SUFFIX)
+
+#if KERNEL_SIZE
+# define GRID_SIZE KERNEL_SIZE
+# define BLOCK_SIZE KERNEL_BLOCK
+# define UNIT_MAX KERNEL_SIZE
+# define UNUSED_CTX(ctx) (void) (ctx)
+#else
+# define GRID_SIZE (ctx->grid_size)
+# define BLOCK_SIZE (ctx->units->block_size)
+# define UNIT_MAX MAX_GRID_SIZE
+# define UNUSED_CTX(ctx)
+#endif
+
+/* Slots of the hash tables of the units, at least twice their cells */
+#if UNIT_MAX <= 8
+# define HASH_SIZE 16
+#elif UNIT_MAX <= 16
+# define HASH_SIZE 32
+#elif UNIT_MAX <= 32
+# define HASH_SIZE 64
+#else
+# define HASH_SIZE 128
+#endif
+
+static bool
+KERNEL (all_different) (sudoku_ctx_t* ctx, pset_t* grid,
+			const uint16_t* unit)
+{
+  const size_t grid_size = GRID_SIZE;
+  pset_t acc = 0;
+
+  UNUSED_CTX (ctx);
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      acc = pset_xor (acc, grid[unit[i]]);
+      if (!pset_is_singleton (grid[unit[i]]))
+	return (false);
+    }
+  return (acc == pset_full (grid_size));
+}
+
+/*
+ * Checks that no cell of the unit is empty, that no two singletons
+ * hold the same color and that every color can still go somewhere, in
+ * one pass: the colors of the singletons seen so far are kept in
+ * `seen`, the ones seen twice in `twice`
+ */
+static bool
+KERNEL (subgrid_consistency) (sudoku_ctx_t* ctx, pset_t* grid,
+			      const uint16_t* unit)
+{
+  const size_t grid_size = GRID_SIZE;
+  pset_t acc = 0;
+  pset_t seen = 0;
+  pset_t twice = 0;
+
+  UNUSED_CTX (ctx);
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t cell = grid[unit[i]];
+
+      if (cell == pset_empty ())
+	return (false);
+      if (pset_is_singleton (cell))
+	{
+	  twice = pset_or (twice, pset_and (seen, cell));
+	  seen = pset_or (seen, cell);
+	}
+      acc = pset_or (acc, cell);
+    }
+
+  return (twice == pset_empty () && acc == pset_full (grid_size));
+}
+
+static bool
+KERNEL (grid_solved) (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool acc = true;
+
+  for (unsigned int u = 0; u < 3 * grid_size; u++)
+    acc = KERNEL (all_different) (ctx, grid, unit_cells (ctx->units, u))
+      && acc;
+
+  return (acc);
+}
+
+/*
+ * Removes the colors of the naked set, made of the cells of the unit
+ * at the positions set in `cells`, from the other cells of the unit
+ */
+static bool
+KERNEL (rm_naked_set) (sudoku_ctx_t* ctx, pset_t* grid,
+		       const uint16_t* unit, pset_t cells, pset_t colors)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t* cell = &grid[unit[i]];
+      pset_t common = pset_and (*cell, colors);
+
+      if ((cells & ((pset_t) 1 << i)) || common == pset_empty ())
+	continue;
+      STATS_ADD (ctx, naked_sets, pset_cardinality (common));
+      cell_set (ctx, cell, pset_and (*cell, pset_negate (colors)));
+      changed = true;
+    }
+  return (changed);
+}
+
+/*
+ * The naked sets heuristic. The cells of the unit are sorted into
+ * classes of equal candidates with a hash table, in one pass, and the
+ * candidates of a class with at least as many cells as candidates
+ * can't go in any other cell. The union of such classes is a naked set
+ * as well, so it is removed from the rest of the unit in one pass.
+ */
+static bool
+KERNEL (naked_set) (sudoku_ctx_t* ctx, pset_t* grid, const uint16_t* unit)
+{
+  const size_t grid_size = GRID_SIZE;
+  pset_t colors[UNIT_MAX];      /* the candidates of each class */
+  pset_t cells[UNIT_MAX];       /* the positions of its cells */
+  uint8_t slots[HASH_SIZE];     /* class of each slot plus one, 0 if
+				   the slot is free */
+  size_t classes = 0;
+  pset_t set_cells = 0;
+  pset_t set_colors = pset_empty ();
+
+  memset (slots, 0, sizeof (slots));
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t key = grid[unit[i]];
+      size_t h = ((key * 0x9e3779b97f4a7c15) >> 32) & (HASH_SIZE - 1);
+
+      while (slots[h] != 0 && colors[slots[h] - 1] != key)
+	h = (h + 1) & (HASH_SIZE - 1);
+      if (slots[h] == 0)
+	{
+	  colors[classes] = key;
+	  cells[classes] = 0;
+	  slots[h] = ++classes;
+	}
+      cells[slots[h] - 1] |= (pset_t) 1 << i;
+    }
+
+  for (size_t c = 0; c < classes; c++)
+    if (colors[c] != pset_empty ()
+	&& pset_cardinality (cells[c]) >= pset_cardinality (colors[c]))
+      {
+	set_cells = pset_or (set_cells, cells[c]);
+	set_colors = pset_or (set_colors, colors[c]);
+      }
+  if (set_colors == pset_empty ())
+    return (false);
+  return (KERNEL (rm_naked_set) (ctx, grid, unit, set_cells, set_colors));
+}
+
+/*
+ * Keeps only the `colors` in the cells of the unit at the positions
+ * set in `cells`
+ */
+static bool
+KERNEL (restrict_cells) (sudoku_ctx_t* ctx, pset_t* grid,
+			 const uint16_t* unit, pset_t cells, pset_t colors)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    if (cells & ((pset_t) 1 << i))
+      {
+	pset_t* cell = &grid[unit[i]];
+	pset_t others = pset_and (*cell, pset_negate (colors));
+
+	if (others == pset_empty ())
+	  continue;
+	STATS_ADD (ctx, hidden_sets, pset_cardinality (others));
+	cell_set (ctx, cell, pset_and (*cell, colors));
+	changed = true;
+      }
+  return (changed);
+}
+
+/*
+ * The hidden sets heuristic. When two (or three) colors can only go
+ * in the same two (or three) cells of the unit, these cells can't
+ * hold any other color. The cells where each color can go are kept as
+ * a bitmask of positions in the unit.
+ */
+static bool
+KERNEL (hidden_set) (sudoku_ctx_t* ctx, pset_t* grid, const uint16_t* unit)
+{
+  const size_t grid_size = GRID_SIZE;
+  pset_t positions[UNIT_MAX];
+  pset_t colors[UNIT_MAX];
+  pset_t placed = pset_empty ();
+  size_t count = 0;
+  bool changed = false;
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    if (pset_is_singleton (grid[unit[i]]))
+      placed = pset_or (placed, grid[unit[i]]);
+
+  /*
+   * Only the colors which can go in two or three cells may belong to
+   * a hidden set
+   */
+  for (unsigned int c = 0; c < grid_size; c++)
+    {
+      pset_t color = (pset_t) 1 << c;
+      pset_t where = 0;
+
+      if (color & placed)
+	continue;
+      for (unsigned int i = 0; i < grid_size; i++)
+	if (grid[unit[i]] & color)
+	  where |= (pset_t) 1 << i;
+      if (pset_cardinality (where) == 2 || pset_cardinality (where) == 3)
+	{
+	  positions[count] = where;
+	  colors[count++] = color;
+	}
+    }
+
+  for (size_t a = 0; a < count; a++)
+    for (size_t b = a + 1; b < count; b++)
+      {
+	pset_t cells = pset_or (positions[a], positions[b]);
+	size_t n = pset_cardinality (cells);
+	bool tmp = false;
+
+	if (n == 2)
+	  tmp = KERNEL (restrict_cells) (ctx, grid, unit, cells,
+					 pset_or (colors[a], colors[b]));
+	for (size_t c = b + 1; n == 3 && c < count; c++)
+	  if (pset_cardinality (pset_or (cells, positions[c])) == 3)
+	    {
+	      bool found = KERNEL (restrict_cells)
+		(ctx, grid, unit, pset_or (cells, positions[c]),
+		 pset_or (pset_or (colors[a], colors[b]), colors[c]));
+	      tmp = tmp || found;
+	    }
+	changed = changed || tmp;
+      }
+  return (changed);
+}
+
+/*
+ * Removes `color` from the cells of the lines (rows if `cover` is 0,
+ * columns if it is 1) at the positions set in `lines`, except for the
+ * cells which cross the lines of the other kind set in `base`
+ */
+static bool
+KERNEL (cross_off_fish) (sudoku_ctx_t* ctx, pset_t* grid, pset_t color,
+			 unsigned int cover, pset_t lines, pset_t base)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+
+  for (unsigned int l = 0; l < grid_size; l++)
+    {
+      if (!(lines & ((pset_t) 1 << l)))
+	continue;
+
+      const uint16_t* line = unit_cells (ctx->units, cover * grid_size + l);
+
+      for (unsigned int i = 0; i < grid_size; i++)
+	if (!(base & ((pset_t) 1 << i)) && (grid[line[i]] & color))
+	  {
+	    STATS_ADD (ctx, fish, 1);
+	    cell_set (ctx, &grid[line[i]],
+		      pset_and (grid[line[i]], pset_negate (color)));
+	    changed = true;
+	  }
+    }
+  return (changed);
+}
+
+/*
+ * The fish heuristic, X-Wings and Swordfish. When a color can only go
+ * in the same two (or three) columns of two (or three) rows, it can't
+ * go in any other row of these columns, and the same goes with the
+ * rows and the columns swapped. The cells where the color can go in
+ * each line are kept as a bitmask of positions in the line.
+ */
+static bool
+KERNEL (fish) (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+
+  for (unsigned int base = 0; base < 2; base++)
+    for (unsigned int c = 0; c < grid_size; c++)
+      {
+	pset_t color = (pset_t) 1 << c;
+	pset_t positions[UNIT_MAX];
+	unsigned int lines[UNIT_MAX];
+	size_t count = 0;
+
+	for (unsigned int l = 0; l < grid_size; l++)
+	  {
+	    const uint16_t* line = unit_cells (ctx->units,
+					       base * grid_size + l);
+	    pset_t where = 0;
+
+	    for (unsigned int i = 0; i < grid_size; i++)
+	      if (grid[line[i]] & color)
+		where |= (pset_t) 1 << i;
+	    if (pset_cardinality (where) == 2 || pset_cardinality (where) == 3)
+	      {
+		positions[count] = where;
+		lines[count++] = l;
+	      }
+	  }
+
+	for (size_t a = 0; a < count; a++)
+	  for (size_t b = a + 1; b < count; b++)
+	    {
+	      pset_t cover = pset_or (positions[a], positions[b]);
+	      size_t n = pset_cardinality (cover);
+
+	      for (size_t d = b; d < count && n <= 3; d++)
+		{
+		  /*
+		   * d == b stands for the X-Wing of a and b, the others
+		   * for the Swordfish of a, b and d
+		   */
+		  pset_t cells = (d == b ? cover
+				  : pset_or (cover, positions[d]));
+		  pset_t base_lines = ((pset_t) 1 << lines[a]
+				       | (pset_t) 1 << lines[b]
+				       | (pset_t) 1 << lines[d]);
+
+		  if (pset_cardinality (cells)
+		      != pset_cardinality (base_lines))
+		    continue;
+		  if (ctx->deps != NULL)
+		    {
+		      deps_t cause = unit_deps (ctx, unit_cells
+						(ctx->units,
+						 base * grid_size + lines[a]));
+
+		      cause = deps_union (cause, unit_deps
+					  (ctx, unit_cells
+					   (ctx->units,
+					    base * grid_size + lines[b])));
+		      ctx->cause = deps_union (cause, unit_deps
+					       (ctx, unit_cells
+						(ctx->units,
+						 base * grid_size + lines[d])));
+		    }
+
+		  bool tmp = KERNEL (cross_off_fish) (ctx, grid, color,
+						      1 - base, cells,
+						      base_lines);
+		  changed = changed || tmp;
+		}
+	    }
+      }
+  return (changed);
+}
+
+/*
+ * Crosses off the `colors` in `grid` either from row `row` or the
+ * column `column` (-1 signifies that that it should not be crossed
+ * off of the row/column, but not on the `k`th block.
+ */
+
+static bool
+KERNEL (cross_off_candidate) (sudoku_ctx_t* ctx, pset_t* grid, pset_t colors,
+			      int row, int col, int k)
+{
+  const units_t* units = ctx->units;
+  const size_t grid_size = GRID_SIZE;
+  const size_t block_size = BLOCK_SIZE;
+  bool changed = false;
+
+  unsigned int init_i = units->block_row[k];
+  unsigned int init_j = units->block_col[k];
+  const uint16_t* line;
+
+  if (row >= 0 && col < 0)
+    {
+      line = unit_cells (units, init_i + row);
+      for (unsigned int c = 0; c < grid_size; c++)
+	if (c < init_j || c >= (init_j + block_size))
+	  {
+	    pset_t* cell = &grid[line[c]];
+	    pset_t tmp = *cell;
+
+	    STATS_ADD (ctx, locked_candidates,
+		       pset_cardinality (pset_and (*cell, colors)));
+	    cell_set (ctx, cell, pset_and (*cell, pset_negate (colors)));
+	    if (tmp != *cell)
+	      changed = true;
+	  }
+    }
+
+  if (col >= 0 && row < 0)
+    {
+      line = unit_cells (units, grid_size + init_j + col);
+      for (unsigned int c = 0; c < grid_size; c++)
+	if (c < init_i || c >= (init_i + block_size))
+	  {
+	    pset_t* cell = &grid[line[c]];
+	    pset_t tmp = *cell;
+
+	    STATS_ADD (ctx, locked_candidates,
+		       pset_cardinality (pset_and (*cell, colors)));
+	    cell_set (ctx, cell, pset_and (*cell, pset_negate (colors)));
+	    if (tmp != *cell)
+	      changed = true;
+	  }
+    }
+
+  return (changed);
+}
+
+/*
+ * A heuristic that removes the candidates that are locked in a
+ * column/row inside the kth block from the cells in that column/row
+ */
+static bool
+KERNEL (rm_locked_candidates) (sudoku_ctx_t* ctx, pset_t* grid, int k)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+  pset_t row_acc, col_acc;
+  const size_t block_size = BLOCK_SIZE;
+  int row = 0;
+  int col = 0;
+
+  const uint16_t* block = unit_cells (ctx->units, 2 * grid_size + k);
+  pset_t row_locked_candidates[BLOCK_SIZE];
+  pset_t col_locked_candidates[BLOCK_SIZE];
+
+  memset (row_locked_candidates, 0, sizeof (row_locked_candidates));
+  memset (col_locked_candidates, 0, sizeof (col_locked_candidates));
+
+  for (unsigned int i = 0; i < grid_size; i += block_size)
+    {
+      for (unsigned int j = i; j < i+block_size; j++)
+	if (!pset_is_singleton (grid[block[j]]))
+	  row_locked_candidates[row] = pset_or (row_locked_candidates[row],
+						grid[block[j]]);
+      row++;
+    }
+
+  for (unsigned int i = 0; i < block_size; i++)
+    {
+      for (unsigned int j = i; j < grid_size; j += block_size)
+	if (!pset_is_singleton (grid[block[j]]))
+	  col_locked_candidates[col] = pset_or (col_locked_candidates[col],
+						grid[block[j]]);
+      col++;
+    }
+
+  for (unsigned int i = 0; i < block_size; i++)
+    {
+      row_acc = row_locked_candidates[i];
+      col_acc = col_locked_candidates[i];
+
+      for (unsigned int j = 0; j < block_size; j++)
+	if (j != i)
+	  {
+	    row_acc = pset_and (row_acc, pset_negate (row_locked_candidates[j]));
+	    col_acc = pset_and (col_acc, pset_negate (col_locked_candidates[j]));
+	  }
+      if (row_acc != pset_empty ())
+	{
+	  bool tmp = KERNEL (cross_off_candidate) (ctx, grid, row_acc,
+						   i, -1, k);
+	  changed = changed || tmp;
+	}
+      if (col_acc != pset_empty ())
+	{
+	  bool tmp = KERNEL (cross_off_candidate) (ctx, grid, col_acc,
+						   -1, i, k);
+	  changed = changed || tmp;
+	}
+    }
+
+  return (changed);
+}
+
+/*
+ * The singles, run on every unit whose cells changed
+ */
+static bool
+KERNEL (singles) (sudoku_ctx_t* ctx, pset_t* grid, const uint16_t* unit)
+{
+  const size_t grid_size = GRID_SIZE;
+  bool changed = false;
+
+  pset_t singletons = 0;
+  pset_t once = 0;
+  pset_t twice = 0;
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t cell = grid[unit[i]];
+
+      if (pset_is_singleton (cell))
+	singletons = pset_or (singletons, cell);
+      twice = pset_or (twice, pset_and (once, cell));
+      once = pset_or (once, cell);
+    }
+
+  /*
+   * The cross-hatching heuristic. Crosses off the already seen
+   * singletons in the subgrid.
+   */
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t* cell = &grid[unit[i]];
+      pset_t seen = pset_and (*cell, singletons);
+
+      if (pset_is_singleton (*cell) || seen == pset_empty ())
+	continue;
+      STATS_ADD (ctx, cross_hatching, pset_cardinality (seen));
+      cell_set (ctx, cell, pset_and (*cell, pset_negate (singletons)));
+      changed = true;
+    }
+
+  /*
+   * The lone number heuristic. Finds a color in a cell which is not
+   * to be found anywhere else. And assigns that color to that
+   * respective cell.
+   */
+  pset_t lone = pset_and (once, pset_negate (twice));
+
+  for (unsigned int i = 0; i < grid_size; i++)
+    {
+      pset_t* cell = &grid[unit[i]];
+      pset_t acc = pset_and (*cell, lone);
+
+      if (pset_is_singleton (*cell) || !pset_is_singleton (acc))
+	continue;
+      STATS_ADD (ctx, lone_number, pset_cardinality (*cell) - 1);
+      cell_set (ctx, cell, acc);
+      changed = true;
+    }
+
+  return (changed);
+}
+
+/*
+ * Runs the stage `stage` on the units (or the grid, for the fish) due
+ * for it, until it changes the grid. Adds an estimate of the cells it
+ * looked at to `work`. Returns true if it changed the grid.
+ */
+static bool
+KERNEL (run_stage) (sudoku_ctx_t* ctx, pset_t* grid, stage_t stage,
+		    unsigned long* work)
+{
+  const size_t grid_size = GRID_SIZE;
+  worklist_t* worklist = &ctx->worklist;
+  uint8_t bit = 1 << stage;
+
+  if (stage == STAGE_FISH)
+    {
+      if (!(worklist->grid_pending & bit))
+	return (false);
+      worklist->grid_pending &= ~bit;
+      *work += 2 * grid_size * grid_size * grid_size;
+      return (KERNEL (fish) (ctx, grid));
+    }
+
+  for (unsigned int u = 0; u < 3 * grid_size; u++)
+    {
+      if (!(worklist->pending[u] & bit))
+	continue;
+      worklist->pending[u] &= ~bit;
+
+      const uint16_t* unit = unit_cells (ctx->units, u);
+      bool changed;
+
+      cause_unit (ctx, unit);
+      switch (stage)
+	{
+	case STAGE_LOCKED_CANDIDATES:
+	  *work += 2 * grid_size;
+	  changed = KERNEL (rm_locked_candidates) (ctx, grid,
+						   u - 2 * grid_size);
+	  break;
+	case STAGE_NAKED_SETS:
+	  *work += 2 * grid_size;
+	  changed = KERNEL (naked_set) (ctx, grid, unit);
+	  break;
+	default:
+	  *work += grid_size * grid_size;
+	  changed = KERNEL (hidden_set) (ctx, grid, unit);
+	  break;
+	}
+      if (changed)
+	return (true);
+    }
+  return (false);
+}
+
+/*
+ * The propagation is a pipeline of stages, from the cheapest to the
+ * most expensive. The singles run until they are stuck, then the
+ * next stages are tried in turn until one of them changes the grid,
+ * after which the singles run again. The stages which stop changing
+ * the grid are skipped for a while, see stage_done.
+ */
+static int
+KERNEL (grid_heuristics) (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  const size_t grid_size = GRID_SIZE;
+  worklist_t* worklist = &ctx->worklist;
+  bool standalone = (worklist->grid != grid);
+  bool changed = true;
+  int ret = 1;
+
+  /*
+   * A grid which isn't under search is propagated from scratch
+   */
+  if (standalone)
+    worklist_reset (ctx, grid);
+
+  STATS_ADD (ctx, propagations, 1);
+  while (changed)
+    {
+      unsigned long work = 0;
+
+      STATS_ADD (ctx, passes, 1);
+      if (ctx->verbose)
+	{
+	  grid_print (ctx, grid, ctx->output_stream);
+	  fprintf (ctx->output_stream, "\n");
+	}
+
+      /*
+       * Only the units with a cell that changed since they were last
+       * looked at are revisited, changing a cell queues its units
+       * again.
+       */
+      while (worklist->length > 0)
+	{
+	  const uint16_t* unit = unit_cells (ctx->units,
+					     worklist_pop (worklist));
+
+	  work += 3 * grid_size;
+	  cause_unit (ctx, unit);
+	  if (!KERNEL (subgrid_consistency) (ctx, grid, unit))
+	    {
+	      ctx->conflict = ctx->cause;
+	      ret = 2;
+	      goto done;
+	    }
+	  KERNEL (singles) (ctx, grid, unit);
+	}
+      stage_done (ctx, STAGE_SINGLES, work, true);
+
+      changed = false;
+      for (unsigned int stage = STAGE_SINGLES + 1;
+	   stage < STAGES && !changed; stage++)
+	if (stage_due (ctx, stage))
+	  {
+	    work = 0;
+	    changed = KERNEL (run_stage) (ctx, grid, stage, &work);
+	    stage_done (ctx, stage, work, changed);
+	  }
+    }
+
+  if (KERNEL (grid_solved) (ctx, grid))
+    ret = 0;
+
+ done:
+  if (standalone)
+    {
+      worklist_clear (ctx);
+      worklist->grid = NULL;
+    }
+  return (ret);
+}
+
+#undef UNUSED_CTX
+#undef BLOCK_SIZE
+#undef GRID_SIZE
+#undef UNIT_MAX
+#undef HASH_SIZE
+#undef KERNEL
+#undef KERNEL_CAT
+#undef KERNEL_CAT_
+#undef KERNEL_SUFFIX
+#undef KERNEL_BLOCK
+#undef KERNEL_SIZE
@@ -0,0 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "parser.h"
+#include "dlx.h"
+#include "portfolio.h"
+
+uint64_t
+seed_default (void)
+{
+  struct timespec now;
+  uint64_t z;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  z = ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec)
+    ^ ((uint64_t) getpid () << 32);
+  z += 0x9e3779b97f4a7c15;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return (z ^ (z >> 31));
+}
+
+sudoku_ctx_t*
+sudoku_ctx_new (void)
+{
+  sudoku_ctx_t* ctx = calloc (1, sizeof (sudoku_ctx_t));
+
+  if (ctx == NULL)
+    return (NULL);
+
+  ctx->seed = seed_default ();
+  return (ctx);
+}
+
+void
+sudoku_ctx_free (sudoku_ctx_t* ctx)
+{
+  if (ctx == NULL)
+    return;
+
+  grid_free (ctx->grid);
+  arena_free (ctx->arena);
+  dlx_free (ctx->dlx);
+  free (ctx);
+}
+
+void
+sudoku_set_verbose (sudoku_ctx_t* ctx, FILE* stream)
+{
+  ctx->verbose = (stream != NULL);
+  ctx->output_stream = stream;
+}
+
+void
+sudoku_set_strict (sudoku_ctx_t* ctx, bool strict)
+{
+  ctx->strict = strict;
+}
+
+void
+sudoku_set_seed (sudoku_ctx_t* ctx, uint64_t seed)
+{
+  ctx->seed = seed;
+}
+
+void
+sudoku_set_engine (sudoku_ctx_t* ctx, sudoku_engine_t engine)
+{
+  ctx->engine = engine;
+}
+
+static const char* const engine_names[] = {
+  [SUDOKU_ENGINE_HEURISTICS] = "heuristics",
+  [SUDOKU_ENGINE_DLX]        = "dlx"
+};
+
+const char*
+sudoku_engine_name (sudoku_engine_t engine)
+{
+  return (engine_names[engine]);
+}
+
+sudoku_status_t
+sudoku_engine_parse (const char* name, sudoku_engine_t* engine)
+{
+  for (size_t k = 0; k < sizeof (engine_names) / sizeof (engine_names[0]);
+       k++)
+    if (strcmp (name, engine_names[k]) == 0)
+      {
+	*engine = k;
+	return (SUDOKU_OK);
+      }
+  return (SUDOKU_EINVAL);
+}
+
+void
+sudoku_set_branch (sudoku_ctx_t* ctx, sudoku_branch_t branch)
+{
+  ctx->branch = branch;
+}
+
+static const char* const branch_names[] = {
+  [SUDOKU_BRANCH_MRV]    = "mrv",
+  [SUDOKU_BRANCH_DEGREE] = "degree",
+  [SUDOKU_BRANCH_LCV]    = "lcv",
+  [SUDOKU_BRANCH_PEERS]  = "peers"
+};
+
+const char*
+sudoku_branch_name (sudoku_branch_t branch)
+{
+  return (branch_names[branch]);
+}
+
+sudoku_status_t
+sudoku_branch_parse (const char* name, sudoku_branch_t* branch)
+{
+  for (size_t k = 0; k < sizeof (branch_names) / sizeof (branch_names[0]);
+       k++)
+    if (strcmp (name, branch_names[k]) == 0)
+      {
+	*branch = k;
+	return (SUDOKU_OK);
+      }
+  return (SUDOKU_EINVAL);
+}
+
+void
+sudoku_set_learning (sudoku_ctx_t* ctx, bool learning)
+{
+  ctx->learning = learning;
+}
+
+void
+sudoku_set_probing (sudoku_ctx_t* ctx, size_t cells)
+{
+  ctx->probes = cells;
+}
+
+void
+sudoku_set_hidden_sets (sudoku_ctx_t* ctx, bool hidden_sets)
+{
+  ctx->hidden_sets = hidden_sets;
+}
+
+void
+sudoku_set_fish (sudoku_ctx_t* ctx, bool fish)
+{
+  ctx->fish = fish;
+}
+
+void
+sudoku_set_restarts (sudoku_ctx_t* ctx, unsigned long dead_ends)
+{
+  ctx->restarts = dead_ends;
+}
+
+/*
+ * Drops the grid of the context if `status` is an error so that the
+ * context never holds a half-parsed grid
+ */
+static sudoku_status_t
+parse_status (sudoku_ctx_t* ctx, sudoku_status_t status)
+{
+  if (status != SUDOKU_OK)
+    {
+      grid_free (ctx->grid);
+      ctx->grid = NULL;
+      ctx->grid_size = 0;
+    }
+  return (status);
+}
+
+sudoku_status_t
+sudoku_parse (sudoku_ctx_t* ctx, FILE* in)
+{
+  return (parse_status (ctx, grid_parser (ctx, in)));
+}
+
+sudoku_status_t
+sudoku_parse_line (sudoku_ctx_t* ctx, const char* line, size_t len)
+{
+  return (parse_status (ctx, grid_parse_line (ctx, line, len)));
+}
+
+/*
+ * Solves the grid of the context with `searches` racing searches
+ */
+static sudoku_status_t
+solve (sudoku_ctx_t* ctx, size_t searches)
+{
+  if (ctx->grid == NULL)
+    return (error_set (ctx, SUDOKU_EINVAL, "no grid to solve"));
+
+#ifndef SUDOKU_NO_STATS
+  struct timespec start, end;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+#endif
+
+  sudoku_status_t status = searches > 1
+    ? portfolio_search (ctx, ctx->grid, searches)
+    : grid_search (ctx, ctx->grid);
+
+#ifndef SUDOKU_NO_STATS
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  ctx->stats.seconds += (end.tv_sec - start.tv_sec)
+    + (end.tv_nsec - start.tv_nsec) / 1e9;
+#endif
+
+  if (status == SUDOKU_UNSOLVABLE)
+    error_set (ctx, status, "grid could not be solved");
+  return (status);
+}
+
+sudoku_status_t
+sudoku_solve (sudoku_ctx_t* ctx)
+{
+  return (solve (ctx, 1));
+}
+
+sudoku_status_t
+sudoku_solve_portfolio (sudoku_ctx_t* ctx, size_t searches)
+{
+  return (solve (ctx, searches));
+}
+
+sudoku_status_t
+sudoku_count (sudoku_ctx_t* ctx, unsigned long limit, unsigned long* count)
+{
+  if (ctx->grid == NULL)
+    return (error_set (ctx, SUDOKU_EINVAL, "no grid to count"));
+
+  pset_t* grid = grid_alloc (ctx);
+
+  if (grid == NULL)
+    return (error_set (ctx, SUDOKU_ENOMEM, "out of memory!"));
+  memcpy (grid, ctx->grid, ctx->grid_size * ctx->grid_size * sizeof (pset_t));
+
+  sudoku_status_t status = grid_count (ctx, grid, limit, count);
+
+  grid_free (grid);
+  return (status);
+}
+
+sudoku_status_t
+sudoku_is_unique (sudoku_ctx_t* ctx, bool* unique)
+{
+  unsigned long count;
+  sudoku_status_t status = sudoku_count (ctx, 2, &count);
+
+  *unique = (status == SUDOKU_OK && count == 1);
+  return (status);
+}
+
+sudoku_status_t
+sudoku_generate (sudoku_ctx_t* ctx, size_t size)
+{
+  return (parse_status (ctx, generate_grid (ctx, size)));
+}
+
+size_t
+sudoku_grid_size (const sudoku_ctx_t* ctx)
+{
+  return (ctx->grid == NULL ? 0 : ctx->grid_size);
+}
+
+void
+sudoku_print (const sudoku_ctx_t* ctx, FILE* out)
+{
+  if (ctx->grid != NULL)
+    grid_print (ctx, ctx->grid, out);
+}
+
+void
+sudoku_to_line (const sudoku_ctx_t* ctx, char line[])
+{
+  if (ctx->grid != NULL)
+    grid_to_line (ctx, ctx->grid, line);
+  else
+    line[0] = '\0';
+}
+
+void
+sudoku_get_stats (const sudoku_ctx_t* ctx, sudoku_stats_t* stats)
+{
+  *stats = ctx->stats;
+}
+
+void
+sudoku_reset_stats (sudoku_ctx_t* ctx)
+{
+  memset (&ctx->stats, 0, sizeof (ctx->stats));
+}
+
+void
+sudoku_add_stats (sudoku_stats_t* total, const sudoku_stats_t* stats)
+{
+  total->decisions         += stats->decisions;
+  total->backtracks        += stats->backtracks;
+  if (stats->max_depth > total->max_depth)
+    total->max_depth = stats->max_depth;
+  total->restarts          += stats->restarts;
+  total->backjumps         += stats->backjumps;
+  total->nogoods           += stats->nogoods;
+  total->probes            += stats->probes;
+  total->propagations      += stats->propagations;
+  total->passes            += stats->passes;
+  total->cross_hatching    += stats->cross_hatching;
+  total->lone_number       += stats->lone_number;
+  total->naked_sets        += stats->naked_sets;
+  total->locked_candidates += stats->locked_candidates;
+  total->nogood_eliminations += stats->nogood_eliminations;
+  total->probe_eliminations += stats->probe_eliminations;
+  total->hidden_sets       += stats->hidden_sets;
+  total->fish              += stats->fish;
+  for (size_t k = 0; k < SUDOKU_STAGES; k++)
+    {
+      total->stages[k].runs  += stats->stages[k].runs;
+      total->stages[k].skips += stats->stages[k].skips;
+      total->stages[k].work  += stats->stages[k].work;
+    }
+  total->seconds           += stats->seconds;
+}
+
+static const char* const stage_names[SUDOKU_STAGES] = {
+  [STAGE_SINGLES]           = "singles",
+  [STAGE_LOCKED_CANDIDATES] = "locked_candidates",
+  [STAGE_NAKED_SETS]        = "naked_sets",
+  [STAGE_HIDDEN_SETS]       = "hidden_sets",
+  [STAGE_FISH]              = "fish",
+};
+
+void
+sudoku_print_stats (const sudoku_stats_t* stats, FILE* out)
+{
+  fprintf (out,
+	   "{\"decisions\": %lu, \"backtracks\": %lu, \"max_depth\": %lu, "
+	   "\"restarts\": %lu, \"backjumps\": %lu, \"nogoods\": %lu, "
+	   "\"probes\": %lu, \"propagations\": %lu, \"passes\": %lu, "
+	   "\"eliminations\": {\"cross_hatching\": %lu, "
+	   "\"lone_number\": %lu, \"naked_sets\": %lu, "
+	   "\"locked_candidates\": %lu, \"nogoods\": %lu, "
+	   "\"probes\": %lu, \"hidden_sets\": %lu, \"fish\": %lu}, "
+	   "\"stages\": {",
+	   stats->decisions, stats->backtracks, stats->max_depth,
+	   stats->restarts, stats->backjumps, stats->nogoods, stats->probes,
+	   stats->propagations, stats->passes, stats->cross_hatching,
+	   stats->lone_number, stats->naked_sets, stats->locked_candidates,
+	   stats->nogood_eliminations, stats->probe_eliminations,
+	   stats->hidden_sets, stats->fish);
+  for (size_t k = 0; k < SUDOKU_STAGES; k++)
+    fprintf (out, "%s\"%s\": {\"runs\": %lu, \"skips\": %lu, "
+	     "\"work\": %lu}", k == 0 ? "" : ", ", stage_names[k],
+	     stats->stages[k].runs, stats->stages[k].skips,
+	     stats->stages[k].work);
+  fprintf (out, "}, \"seconds\": %.6f}\n", stats->seconds);
+}
+
+const char*
+sudoku_error (const sudoku_ctx_t* ctx)
+{
+  return (ctx->error);
+}
+
+const char*
+sudoku_strerror (sudoku_status_t status)
+{
+  switch (status)
+    {
+    case SUDOKU_OK:
+      return ("success");
+    case SUDOKU_UNSOLVABLE:
+      return ("grid could not be solved");
+    case SUDOKU_ENOMEM:
+      return ("out of memory");
+    case SUDOKU_ESIZE:
+      return ("wrong grid size");
+    case SUDOKU_EPARSE:
+      return ("malformed grid");
+    case SUDOKU_EINVAL:
+      return ("no grid");
+    }
+  return ("unknown error");
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "units.h"
+#include "simd9.h"
+#include "lockstep.h"
+
+#if SIMD9
+
+/*
+ * Lane n of the vector cells[c] holds the candidates of the cell c of
+ * the nth grid, as a 16-bit mask, so that each operation of the
+ * propagation advances all the grids at once. The lanes without a
+ * grid hold a solved one, which never changes.
+ *
+ * The propagation is the one of simd9.c (cross-hatching, lone numbers
+ * and locked candidates) until no grid changes anymore, the grids
+ * still unsolved then go through the scalar search. Most of the grids
+ * of test/sudoku17 don't need any choice: with one thread, the batch
+ * mode solves its 49151 grids in 2.6 s against 5.1 s when they go
+ * through simd9.c one at a time.
+ *
+ * Unlike simd9.c, the propagation has no lanes to gather and gains
+ * from the wider registers: on a faster machine the same run takes
+ * 0.75 s with AVX2 against 0.95 s with SSE2, so AVX2 is used whenever
+ * simd9_avx2 finds it.
+ */
+
+#define CELLS 81
+#define FULL9 0x1ff
+
+#define LOCK_BYTES (2 * LOCKSTEP_LANES)
+
+typedef uint16_t lock_t __attribute__ ((vector_size (LOCK_BYTES)));
+typedef int16_t lock_mask_t __attribute__ ((vector_size (LOCK_BYTES)));
+
+#define lock_select(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+#define lock_nonzero(x) ((lock_t) ((lock_mask_t) ((x) != 0)))
+#define lock_singletons(x) \
+  ((lock_t) ((lock_mask_t) (((x) & ((x) - 1)) == 0)))
+
+static inline __attribute__ ((always_inline)) bool
+lock_any (const lock_t* v)
+{
+  uint16_t acc = 0;
+
+  for (int n = 0; n < LOCKSTEP_LANES; n++)
+    acc |= (*v)[n];
+  return (acc != 0);
+}
+
+/*
+ * The values of the segment `s` out of `segs[0..2]` found in neither
+ * of the two other segments
+ */
+#define lock_only(segs, s) \
+  ((segs)[s] & ~((segs)[((s) + 1) % 3] | (segs)[((s) + 2) % 3]))
+
+/*
+ * Cross-hatching and lone numbers on every unit, adds the lanes which
+ * changed to `changed` and the inconsistent ones to `failed`
+ */
+static inline __attribute__ ((always_inline)) void
+lock_units (lock_t cells[CELLS], const uint16_t* unit, lock_t* changed,
+	    lock_t* failed)
+{
+  for (int u = 0; u < 27; u++, unit += 9)
+    {
+      lock_t once = {0}, twice = {0}, placed = {0};
+      lock_t dup = {0}, empty = {0}, bad = {0};
+
+      for (int k = 0; k < 9; k++)
+	{
+	  lock_t x = cells[unit[k]];
+	  lock_t single = lock_singletons (x);
+
+	  dup |= placed & single & x;
+	  placed |= single & x;
+	  empty |= ~lock_nonzero (x);
+	  twice |= once & x;
+	  once |= x;
+	}
+
+      lock_t hidden = once & ~twice & ~placed;
+
+      for (int k = 0; k < 9; k++)
+	{
+	  lock_t x = cells[unit[k]];
+	  lock_t y = lock_select (lock_singletons (x), x, x & ~placed);
+	  lock_t lone = y & hidden;
+
+	  bad |= lone & (lone - 1);
+	  y = lock_select (lock_nonzero (lone), lone, y);
+	  *changed |= x ^ y;
+	  cells[unit[k]] = y;
+	}
+      *failed |= lock_nonzero (dup | empty | (once ^ FULL9) | bad);
+    }
+}
+
+/*
+ * The locked candidates of every block, row and column, adds the lanes
+ * which changed to `changed`
+ */
+static inline __attribute__ ((always_inline)) void
+lock_segments (lock_t cells[CELLS], lock_t* changed)
+{
+  lock_t rows[9][3], cols[9][3];          /* segments of 3 cells */
+  lock_t claim_rows[9][3], claim_cols[9][3];
+  lock_t point_rows[9][3], point_cols[9][3];
+
+  for (int i = 0; i < 9; i++)
+    for (int s = 0; s < 3; s++)
+      {
+	rows[i][s] = cells[i * 9 + 3 * s] | cells[i * 9 + 3 * s + 1]
+	  | cells[i * 9 + 3 * s + 2];
+	cols[i][s] = cells[(3 * s) * 9 + i] | cells[(3 * s + 1) * 9 + i]
+	  | cells[(3 * s + 2) * 9 + i];
+      }
+
+  /*
+   * claim_rows[i][s]: values of the row i locked in its block of the
+   * stack s, point_rows[i][s]: values of the block of the row i and
+   * the stack s locked in the row i, the same goes for the columns
+   */
+  for (int i = 0; i < 9; i++)
+    for (int s = 0; s < 3; s++)
+      {
+	int i1 = (i / 3) * 3 + (i + 1) % 3;
+	int i2 = (i / 3) * 3 + (i + 2) % 3;
+
+	claim_rows[i][s] = lock_only (rows[i], s);
+	claim_cols[i][s] = lock_only (cols[i], s);
+	point_rows[i][s] = rows[i][s] & ~(rows[i1][s] | rows[i2][s]);
+	point_cols[i][s] = cols[i][s] & ~(cols[i1][s] | cols[i2][s]);
+      }
+
+  for (int c = 0; c < CELLS; c++)
+    {
+      int i = c / 9, j = c % 9;
+      lock_t locked = {0};
+
+      for (int o = 1; o < 3; o++)
+	{
+	  locked |= claim_rows[(i / 3) * 3 + (i + o) % 3][j / 3];
+	  locked |= claim_cols[(j / 3) * 3 + (j + o) % 3][i / 3];
+	  locked |= point_rows[i][(j / 3 + o) % 3];
+	  locked |= point_cols[j][(i / 3 + o) % 3];
+	}
+      *changed |= cells[c] & locked;
+      cells[c] &= ~locked;
+    }
+}
+
+/*
+ * Propagates all the lanes until none of the consistent ones changes,
+ * `failed` gets the inconsistent ones
+ */
+static inline __attribute__ ((always_inline)) void
+lock_propagate (lock_t cells[CELLS], const uint16_t* unit, lock_t* failed)
+{
+  lock_t changed;
+
+  *failed = (lock_t) {0};
+  do
+    {
+      changed = (lock_t) {0};
+      lock_units (cells, unit, &changed, failed);
+      lock_segments (cells, &changed);
+      changed &= ~*failed;
+    }
+  while (lock_any (&changed));
+}
+
+static void __attribute__ ((target ("avx2")))
+lock_propagate_avx2 (lock_t cells[CELLS], const uint16_t* unit,
+		     lock_t* failed)
+{
+  lock_propagate (cells, unit, failed);
+}
+
+static void
+lock_propagate_sse2 (lock_t cells[CELLS], const uint16_t* unit,
+		     lock_t* failed)
+{
+  lock_propagate (cells, unit, failed);
+}
+
+void
+lockstep_solve (sudoku_ctx_t* ctx, pset_t* grids[],
+		sudoku_status_t status[], size_t count)
+{
+  lock_t cells[CELLS];
+  lock_t failed;
+  sudoku_status_t resized = grid_resize (ctx, 9);
+
+  if (resized != SUDOKU_OK)
+    {
+      for (size_t n = 0; n < count; n++)
+	status[n] = resized;
+      return;
+    }
+
+  for (int c = 0; c < CELLS; c++)
+    for (size_t n = 0; n < LOCKSTEP_LANES; n++)
+      cells[c][n] = n < count ? grids[n][c]
+	: (pset_t) 1 << (((c / 9) * 3 + (c / 9) / 3 + c % 9) % 9);
+
+  if (simd9_avx2 ())
+    lock_propagate_avx2 (cells, ctx->units->unit_cells, &failed);
+  else
+    lock_propagate_sse2 (cells, ctx->units->unit_cells, &failed);
+
+  for (size_t n = 0; n < count; n++)
+    {
+      bool solved = true;
+
+      if (failed[n])
+	{
+	  status[n] = SUDOKU_UNSOLVABLE;
+	  continue;
+	}
+      for (int c = 0; c < CELLS; c++)
+	{
+	  grids[n][c] = cells[c][n];
+	  if (!pset_is_singleton (grids[n][c]))
+	    solved = false;
+	}
+      status[n] = solved ? SUDOKU_OK : grid_search (ctx, grids[n]);
+    }
+}
+
+#else
+
+void
+lockstep_solve (sudoku_ctx_t* ctx, pset_t* grids[],
+		sudoku_status_t status[], size_t count)
+{
+  sudoku_status_t resized = grid_resize (ctx, 9);
+
+  for (size_t n = 0; n < count; n++)
+    status[n] = resized == SUDOKU_OK ? grid_search (ctx, grids[n])
+      : resized;
+}
+
+#endif /* SIMD9 */
@@ -0,0 +1,18 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+/* Number of 9x9 grids propagated together */
+#define LOCKSTEP_LANES 16
+
+/*
+ * Solves the `count` 9x9 grids `grids`, at most LOCKSTEP_LANES of
+ * them, in place and sets `status[n]` to SUDOKU_OK or
+ * SUDOKU_UNSOLVABLE like grid_search (or SUDOKU_ENOMEM). The grids are
+ * propagated side by side in the lanes of SIMD vectors, the ones left
+ * with choices to make are then searched one by one in `ctx`, whose
+ * grid is resized to 9x9.
+ */
+void lockstep_solve (sudoku_ctx_t* ctx, pset_t* grids[],
+		     sudoku_status_t status[], size_t count);
+
+#endif /* LOCKSTEP_H */
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <libgen.h>
 #include <getopt.h>
 
@@ -5,11 +6,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <libsudoku.h>
 #include <preemptive_set.h>
 
-#include "parser.h"
+#include "batch.h"
+#include "main.h"
 #include "sudoku.h"
 
+char* exec_name;
+
+/* Value of getopt_long for the options without a short name */
+#define OPT_STATS 256
+#define OPT_ENGINE 257
+#define OPT_COUNT 258
+#define OPT_SEED 259
+#define OPT_BRANCH 260
+#define OPT_RESTARTS 261
+#define OPT_PORTFOLIO 262
+#define OPT_LEARNING 263
+#define OPT_PROBE 264
+#define OPT_HIDDEN_SETS 265
+#define OPT_FISH 266
+
+/* All non-error messages are written to this stream */
+static FILE* output_stream;
+/* The context of the grid being solved or generated */
+static sudoku_ctx_t* ctx;
+
 void
 usage (int status)
 {
@@ -19,20 +42,49 @@ usage (int status)
 	"Usage: %s [OPTION] FILE\n"
         "Solve Sudoku puzzles of variable sizes (1-64)\n"
 	"\n"
+	"  -b, --batch         solve one grid per line of FILE (or stdin)\n"
+	"  -j, --jobs=N        use N threads in batch mode or to generate\n"
+	"                      grids with -n (by default 1)\n"
 	"  -o, --output=FILE   write result to FILE\n"
-	"  -s, --strict        generate a unique-solution grid"
+	"  -s, --strict        generate a unique-solution grid\n"
 	"  -g, --generate=SIZE generates a grid of size SIZE (by default 9)\n"
+	"  -n, --number=COUNT  generate COUNT grids, one per line, with the\n"
+	"                      threads of --jobs\n"
+	"      --seed=N        seed of the generated grids (by default drawn\n"
+	"                      from the clock and the process id)\n"
+	"      --engine=NAME   search with NAME: heuristics (the default)\n"
+	"                      or dlx, an exact cover search\n"
+	"      --branch=NAME   choices of the heuristics engine: mrv (the\n"
+	"                      default), degree, lcv or peers\n"
+	"      --restarts[=N]  restart the search after N dead ends (by\n"
+	"                      default %d), then after N times the Luby\n"
+	"                      sequence, with random tie-breaks\n"
+	"      --portfolio=N   race N differently configured searches on\n"
+	"                      each grid, on as many threads\n"
+	"      --learning      backjump over the choices a conflict doesn't\n"
+	"                      depend on and learn nogoods from it\n"
+	"      --probe[=N]     rule out the candidates of N cells (by\n"
+	"                      default %d) that fail right away, before\n"
+	"                      each choice\n"
+	"      --hidden-sets   look for hidden pairs and triples\n"
+	"      --fish          look for X-Wings and Swordfish\n"
+	"      --count[=K]     count the solutions of the grids instead of\n"
+	"                      solving them, stop at K solutions if given\n"
+	"      --stats         write the counters of the solver on stderr\n"
+	"                      as JSON, batch mode then solves the grids\n"
+	"                      one at a time\n"
         "  -v, --verbose       verbose output\n"
 	"  -V, --version       display version and exit\n"
 	"  -h, --help          display this help\n", 
-        basename(exec_name));
+        basename(exec_name), SUDOKU_DEFAULT_RESTARTS,
+	SUDOKU_DEFAULT_PROBES);
     }
   else
     {
       fprintf (stderr, "Try `%s --help` for more information\n", 
 	       basename(exec_name));
     }
-  grid_free (grid);
+  sudoku_ctx_free (ctx);
   
   fclose (output_stream);  
   exit (status);
@@ -51,13 +103,50 @@ int
 main (int argc, char* argv[])
 {
   int optc;
+  int status = EXIT_SUCCESS;
+  bool batch = false;
+  bool verbose = false;
+  bool stats = false;
+  bool count = false;
+  long count_limit = 0;
+  sudoku_stats_t counters = {0};
+  int generate = 0;
+  long puzzles = 0;
+  bool strict = false;
+  bool seeded = false;
+  uint64_t seed = 0;
+  bool pooled = false;          /* the counters come from the workers */
+  long jobs = 1;
+  sudoku_engine_t engine = SUDOKU_ENGINE_HEURISTICS;
+  sudoku_branch_t branch = SUDOKU_BRANCH_MRV;
+  long restarts = 0;
+  long portfolio = 1;
+  bool learning = false;
+  long probes = 0;
+  bool hidden_sets = false;
+  bool fish = false;
+  sudoku_status_t ret;
   FILE* fp, *in; 
   struct option long_opts[] = 
     {
+      {"batch",    no_argument,       0, 'b'},
+      {"jobs",     required_argument, 0, 'j'},
       {"output",   required_argument, 0, 'o'},
       {"generate", optional_argument, 0, 'g'},
+      {"number",   required_argument, 0, 'n'},
+      {"seed",     required_argument, 0, OPT_SEED},
       {"strict",   no_argument,       0, 's'},
       {"verbose",  no_argument,       0, 'v'},
+      {"stats",    no_argument,       0, OPT_STATS},
+      {"engine",   required_argument, 0, OPT_ENGINE},
+      {"branch",   required_argument, 0, OPT_BRANCH},
+      {"restarts", optional_argument, 0, OPT_RESTARTS},
+      {"portfolio", required_argument, 0, OPT_PORTFOLIO},
+      {"learning", no_argument,       0, OPT_LEARNING},
+      {"probe",    optional_argument, 0, OPT_PROBE},
+      {"hidden-sets", no_argument,    0, OPT_HIDDEN_SETS},
+      {"fish",     no_argument,       0, OPT_FISH},
+      {"count",    optional_argument, 0, OPT_COUNT},
       {"version",  no_argument,       0, 'V'},
       {"help",     no_argument,       0, 'h'},
       {NULL, 0, NULL, 0}
@@ -67,10 +156,30 @@ main (int argc, char* argv[])
   output_stream = stdout;
   in = NULL;
 
-  while ((optc = getopt_long (argc, argv, "o:vVshg::", long_opts, NULL)) != -1)
+  ctx = sudoku_ctx_new ();
+  if (ctx == NULL)
+    {
+      fprintf (stderr, "%s: error: out of memory!\n", exec_name);
+      exit (EXIT_FAILURE);
+    }
+
+  while ((optc = getopt_long (argc, argv, "bj:o:vVshg::n:", long_opts, NULL)) != -1)
     {
       switch (optc)
 	{
+	case 'b':
+	  batch = true;
+	  break;
+
+	case 'j':
+	  jobs = atol (optarg);
+	  if (jobs < 1)
+	    {
+	      fprintf (stderr, "Wrong number of jobs: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
 	case 'o':
 	  fp = fopen (optarg, "w");
 	  if (fp == NULL)
@@ -83,11 +192,24 @@ main (int argc, char* argv[])
 	  break;
 
 	case 'g':
-	  if (optarg)
-	    generate_grid (atoi (optarg));
-	  else
-	    generate_grid (9);
-	  goto freeoutput;
+	  /* The size may also be the next argument */
+	  if (optarg == NULL && optind < argc && isdigit (argv[optind][0]))
+	    optarg = argv[optind++];
+	  generate = optarg ? atoi (optarg) : 9;
+	  break;
+
+	case 'n':
+	  puzzles = atol (optarg);
+	  if (puzzles < 1)
+	    {
+	      fprintf (stderr, "Wrong number of grids: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_SEED:
+	  seed = strtoull (optarg, NULL, 10);
+	  seeded = true;
 	  break;
 
 	case 's':
@@ -98,6 +220,75 @@ main (int argc, char* argv[])
 	  verbose = true;
 	  break; 
 
+	case OPT_STATS:
+	  stats = true;
+	  break;
+
+	case OPT_COUNT:
+	  count = true;
+	  count_limit = optarg ? atol (optarg) : 0;
+	  if (optarg && count_limit < 1)
+	    {
+	      fprintf (stderr, "Wrong number of solutions: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_ENGINE:
+	  if (sudoku_engine_parse (optarg, &engine) != SUDOKU_OK)
+	    {
+	      fprintf (stderr, "Unknown engine: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_BRANCH:
+	  if (sudoku_branch_parse (optarg, &branch) != SUDOKU_OK)
+	    {
+	      fprintf (stderr, "Unknown branching: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_RESTARTS:
+	  restarts = optarg ? atol (optarg) : SUDOKU_DEFAULT_RESTARTS;
+	  if (restarts < 1)
+	    {
+	      fprintf (stderr, "Wrong number of dead ends: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_PORTFOLIO:
+	  portfolio = atol (optarg);
+	  if (portfolio < 1)
+	    {
+	      fprintf (stderr, "Wrong number of searches: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_LEARNING:
+	  learning = true;
+	  break;
+
+	case OPT_PROBE:
+	  probes = optarg ? atol (optarg) : SUDOKU_DEFAULT_PROBES;
+	  if (probes < 1)
+	    {
+	      fprintf (stderr, "Wrong number of cells: %s\n", optarg);
+	      usage (EXIT_FAILURE);
+	    }
+	  break;
+
+	case OPT_HIDDEN_SETS:
+	  hidden_sets = true;
+	  break;
+
+	case OPT_FISH:
+	  fish = true;
+	  break;
+
 	case 'V':
 	  version ();
 	  break;
@@ -111,7 +302,83 @@ main (int argc, char* argv[])
 	}
     }
 
-  if (optind != argc -1)
+  if (verbose)
+    sudoku_set_verbose (ctx, output_stream);
+  sudoku_set_engine (ctx, engine);
+  sudoku_set_branch (ctx, branch);
+  sudoku_set_restarts (ctx, restarts);
+  sudoku_set_learning (ctx, learning);
+  sudoku_set_probing (ctx, probes);
+  sudoku_set_hidden_sets (ctx, hidden_sets);
+  sudoku_set_fish (ctx, fish);
+  sudoku_set_strict (ctx, strict);
+  if (seeded)
+    sudoku_set_seed (ctx, seed);
+  else
+    seed = seed_default ();
+
+  if (generate != 0 && puzzles > 0)
+    {
+      batch_options_t options = {
+	.workers = jobs,
+	.engine = engine,
+	.branch = branch,
+	.restarts = restarts,
+	.learning = learning,
+	.probes = probes,
+	.hidden_sets = hidden_sets,
+	.fish = fish,
+	.stats = stats ? &counters : NULL,
+	.size = generate,
+	.puzzles = puzzles,
+	.strict = strict,
+	.seed = seed
+      };
+
+      if (!batch_generate (output_stream, &options))
+	status = EXIT_FAILURE;
+      pooled = true;
+    }
+  else if (generate != 0)
+    {
+      ret = sudoku_generate (ctx, generate);
+      if (ret != SUDOKU_OK)
+	{
+	  fprintf (stderr, "%s: error: %s\n", exec_name, sudoku_error (ctx));
+	  usage (EXIT_FAILURE);
+	}
+      sudoku_print (ctx, output_stream);
+    }
+  else if (batch && optind >= argc - 1)
+    {
+      in = (optind == argc) ? stdin : fopen (argv[optind], "r");
+      if (in == NULL)
+	{
+	  fprintf (stderr, "Cannot open file: %s\n", argv[optind]);
+	  usage (EXIT_FAILURE);
+	}
+      batch_options_t options = {
+	.workers = jobs,
+	.engine = engine,
+	.branch = branch,
+	.restarts = restarts,
+	.learning = learning,
+	.probes = probes,
+	.hidden_sets = hidden_sets,
+	.fish = fish,
+	.portfolio = portfolio,
+	.stats = stats ? &counters : NULL,
+	.count = count,
+	.count_limit = count_limit
+      };
+
+      if (!batch_solve (in, output_stream, &options))
+	status = EXIT_FAILURE;
+      pooled = true;
+      if (in == stdin)
+	in = NULL;
+    }
+  else if (optind != argc -1)
     usage (EXIT_FAILURE);
   else
     {
@@ -121,16 +388,58 @@ main (int argc, char* argv[])
 	  fprintf (stderr, "Cannot open file: %s\n", argv[optind]);
 	  usage (EXIT_FAILURE);
 	}
-      grid_parser (in);
-      grid_solver (grid);
-      grid_free (grid);
+      ret = sudoku_parse (ctx, in);
+      if (ret != SUDOKU_OK)
+	{
+	  fclose (in);
+	  fprintf (stderr, "%s: error: %s\n", exec_name, sudoku_error (ctx));
+	  usage (EXIT_FAILURE);
+	}
+      if (count)
+	{
+	  unsigned long solutions;
+
+	  if (sudoku_count (ctx, count_limit, &solutions) != SUDOKU_OK)
+	    {
+	      fprintf (stderr, "%s: error: %s\n", exec_name,
+		       sudoku_error (ctx));
+	      status = EXIT_FAILURE;
+	    }
+	  else
+	    fprintf (output_stream, "Grid has %s%lu solution%s\n",
+		     count_limit != 0
+		     && solutions == (unsigned long) count_limit
+		     ? "at least " : "",
+		     solutions, solutions == 1 ? "" : "s");
+	}
+      else
+	switch (sudoku_solve_portfolio (ctx, portfolio))
+	  {
+	  case SUDOKU_OK:
+	    fprintf (output_stream, "Grid has been solved\n");
+	    sudoku_print (ctx, output_stream);
+	    break;
+	  case SUDOKU_UNSOLVABLE:
+	    fprintf (output_stream, "Grid could not be solved\n");
+	    break;
+	  default:
+	    fprintf (stderr, "%s: error: %s\n", exec_name,
+		     sudoku_error (ctx));
+	    status = EXIT_FAILURE;
+	  }
+    }
+  if (stats)
+    {
+      if (!pooled)
+	sudoku_get_stats (ctx, &counters);
+      sudoku_print_stats (&counters, stderr);
     }
- freeoutput:
+  sudoku_ctx_free (ctx);
   if ((output_stream != stdout && fclose (output_stream) != 0) ||
       (in != NULL && fclose (in) != 0))
     {
       fprintf (stderr, "File cannot be closed\n");
       exit (EXIT_FAILURE);
     }
-  exit (EXIT_SUCCESS);
+  exit (status);
 }
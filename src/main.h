@@ -1,10 +1,13 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+/* The name of the exectuable taken from argv[0] */
+extern char* exec_name;
+
 /*
  * Exits the program with status `status` but prints the usage
- * instructions beforehand. It also cleans up (like freeing the grid
- * pointed to by the global variable.
+ * instructions beforehand. It also cleans up (like freeing the
+ * context of the grid).
  */
 void usage (int status);
 
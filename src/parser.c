@@ -3,10 +3,10 @@
 #include <preemptive_set.h>
 
 #include "sudoku.h"
-#include "main.h"
+#include "parser.h"
 
 static bool
-check_input_char (char c)
+check_input_char (const sudoku_ctx_t* ctx, char c)
 {
   const char tbl[] = "123456789"
                      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -15,52 +15,49 @@ check_input_char (char c)
   if (c == '_')
     return (true);
 
-  for (unsigned int i = 0; i < grid_size; i++)
+  for (unsigned int i = 0; i < ctx->grid_size; i++)
     if (c == tbl[i])
       return (true);
-  
+
   return (false);
 }
 
-static void
-bad_character (int line_number, char c, FILE* in)
+static sudoku_status_t
+bad_character (sudoku_ctx_t* ctx, int line_number, char c)
 {
-  fclose (in);
-  fprintf (stderr, 
-	   "%s: error: wrong character \'%c\' at line %d\n", 
-	   exec_name, c, line_number);
-  usage (EXIT_FAILURE);
+  return (error_set (ctx, SUDOKU_EPARSE,
+		     "wrong character \'%c\' at line %d", c, line_number));
 }
 
-static void
-bad_number_of_lines (FILE* in)
+static sudoku_status_t
+bad_number_of_lines (sudoku_ctx_t* ctx)
 {
-  fclose (in);
-  fprintf (stderr,
-	   "%s: error: too many/few lines in the grid\n",
-	   exec_name);
-  usage (EXIT_FAILURE);
+  return (error_set (ctx, SUDOKU_EPARSE,
+		     "too many/few lines in the grid"));
 }
 
-static void
-bad_line (int line_number, FILE* in)
+static sudoku_status_t
+bad_line (sudoku_ctx_t* ctx, int line_number)
 {
-  fclose (in);
-  fprintf (stderr,
-	   "%s: error: line %d is malformed (wrong number of cells)\n",
-	   exec_name, line_number);
-  usage (EXIT_FAILURE);
+  return (error_set (ctx, SUDOKU_EPARSE,
+		     "line %d is malformed (wrong number of cells)",
+		     line_number));
 }
 
-void
-grid_parser (FILE *in)
+sudoku_status_t
+grid_parser (sudoku_ctx_t* ctx, FILE *in)
 {
   int current_char, c;
   unsigned int i = 0; /* current line */
   unsigned int j = 0; /* current column */
+  sudoku_status_t status;
 
   char first_line[MAX_GRID_SIZE];
-  
+
+  grid_free (ctx->grid);
+  ctx->grid = NULL;
+  ctx->grid_size = 0;
+
   while ((current_char = fgetc (in)) != EOF)
     {
       switch (current_char)
@@ -77,82 +74,121 @@ grid_parser (FILE *in)
 	    ;
 	  if (c == EOF)
 	    break;
-	  
+
 	case '\n':
 	  /*
 	   * empty lines should be ignored
 	   */
-	  if (j == 0) 
+	  if (j == 0)
 	      break;
 
 	  if (i == 0)
 	    {
-	      check_size_of_grid (j, in);
-	      grid_size = j;
-	      grid = grid_alloc ();
-	      
-	      for (unsigned int k = 0; k < grid_size; k++)
+	      if (!valid_grid_size (j))
+		return (error_set (ctx, SUDOKU_ESIZE,
+				   "wrong grid size: %d", j));
+	      if ((status = grid_resize (ctx, j)) != SUDOKU_OK)
+		return (status);
+
+	      for (unsigned int k = 0; k < ctx->grid_size; k++)
 		{
-		  if (!check_input_char (first_line[k]))
-		    bad_character (i + 1, first_line[k], in);
+		  if (!check_input_char (ctx, first_line[k]))
+		    return (bad_character (ctx, i + 1, first_line[k]));
 		  if (first_line[k] == '_')
-		    grid[0][k] = pset_full (grid_size);
+		    ctx->grid[k] = pset_full (ctx->grid_size);
 		  else
-		    grid[0][k] = char2pset (first_line[k]);
+		    ctx->grid[k] = char2pset (first_line[k]);
 		}
 	    }
-	  if (j < grid_size)
-	    bad_line (i + 1, in);
+	  if (j < ctx->grid_size)
+	    return (bad_line (ctx, i + 1));
 
 	  i++;
-	  j = 0;	  
+	  j = 0;
 	  break;
 
 	default:
-	  if (grid_size != 0 && i >= grid_size)
-	    bad_number_of_lines (in);
+	  if (ctx->grid_size != 0 && i >= ctx->grid_size)
+	    return (bad_number_of_lines (ctx));
+
+	  if (ctx->grid_size != 0 && j >= ctx->grid_size)
+	    return (bad_line (ctx, i + 1));
+
+	  if (j >= MAX_GRID_SIZE)
+	    return (error_set (ctx, SUDOKU_ESIZE, "grid is too big"));
 
-	  if (grid_size != 0 && j >= grid_size)
-	    bad_line (i + 1, in);
-	  
 	  if (i == 0)
 	    first_line[j] = current_char;
 	  else
 	    {
-	      if (!check_input_char(current_char))
-		bad_character(i + 1, current_char, in);
+	      if (!check_input_char (ctx, current_char))
+		return (bad_character (ctx, i + 1, current_char));
 	      if (current_char == '_')
-		grid[i][j] = pset_full (grid_size);
+		ctx->grid[i * ctx->grid_size + j] = pset_full (ctx->grid_size);
 	      else
-		grid[i][j] = char2pset (current_char);
+		ctx->grid[i * ctx->grid_size + j] = char2pset (current_char);
 	    }
 	  j++;
-
-	  if (j > MAX_GRID_SIZE)
-	    {
-	      fprintf (stderr, "Grid is too big\n");
-	      usage (EXIT_FAILURE);
-	    }
 	}
     }
   /*
    * The case of the grid of size 1 without a newline at the end
    */
-  if (grid_size == 0 && j == 1)
+  if (ctx->grid_size == 0 && j == 1)
     {
-      grid_size = 1;
-      grid = grid_alloc ();
+      if ((status = grid_resize (ctx, 1)) != SUDOKU_OK)
+	return (status);
 
       if (first_line[0] == '_')
-	grid[0][0] = pset_full (grid_size);
+	ctx->grid[0] = pset_full (ctx->grid_size);
       else
-	grid[0][0] = char2pset (first_line[0]);
+	ctx->grid[0] = char2pset (first_line[0]);
     }
   /*
    * The right part of the disjunction handles the case of reading the
    * grid that doesn't have a newline at the end, which should be read
    * as a correct one.
    */
-  if (i < grid_size - 1 || ((i == grid_size - 1) && (j != grid_size)))
-      bad_number_of_lines (in);
+  if (ctx->grid_size == 0 || i < ctx->grid_size - 1
+      || ((i == ctx->grid_size - 1) && (j != ctx->grid_size)))
+    return (bad_number_of_lines (ctx));
+
+  return (SUDOKU_OK);
+}
+
+sudoku_status_t
+grid_parse_line (sudoku_ctx_t* ctx, const char* line, size_t len)
+{
+  size_t size = 0;
+  sudoku_status_t status;
+
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'
+		     || line[len - 1] == ' ' || line[len - 1] == '\t'))
+    len--;
+
+  while (size * size < len)
+    size++;
+  if (size * size != len || !valid_grid_size (size))
+    return (error_set (ctx, SUDOKU_ESIZE,
+		       "wrong line length: %zu", len));
+
+  if ((status = grid_resize (ctx, size)) != SUDOKU_OK)
+    return (status);
+
+  for (size_t k = 0; k < len; k++)
+    {
+      char c = line[k];
+
+      if (c == '0' || c == '.')
+	c = '_';
+      if (!check_input_char (ctx, c))
+	return (error_set (ctx, SUDOKU_EPARSE,
+			   "wrong character \'%c\' at column %zu",
+			   line[k], k + 1));
+      if (c == '_')
+	ctx->grid[k] = pset_full (size);
+      else
+	ctx->grid[k] = char2pset (c);
+    }
+  return (SUDOKU_OK);
 }
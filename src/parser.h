@@ -3,11 +3,21 @@
 
 /*
  * Parses the grid in the stream `in` and expects it to be opened
- * beforehand. Exits the program with an error if it can't parse the
- * input. It doesn't close the file. And writes the parsed grid in the
- * global variable `grid` and the size of it on the global variable
- * `grid_size`. 
+ * beforehand. It doesn't close the file. And writes the parsed grid
+ * in `ctx->grid` and the size of it in `ctx->grid_size`. Returns
+ * SUDOKU_EPARSE or SUDOKU_ESIZE, with the reason in the error message
+ * of the context, if it can't parse the input.
  */
-void grid_parser (FILE *in);
+sudoku_status_t grid_parser (sudoku_ctx_t* ctx, FILE *in);
+
+/*
+ * Parses a grid written on a single line of `len` characters (the
+ * format of `test/sudoku17`), where '0', '.' and '_' stand for an
+ * empty cell. The size of the grid is the square root of the length
+ * of the line, trailing blanks and newlines are ignored. Writes the
+ * grid in the context like `grid_parser`.
+ */
+sudoku_status_t grid_parse_line (sudoku_ctx_t* ctx, const char* line,
+				 size_t len);
 
 #endif /* PARSER_H */
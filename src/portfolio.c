@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libsudoku.h>
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "portfolio.h"
+
+/* Number of branching strategies the restarting searches go through */
+#define BRANCHES (SUDOKU_BRANCH_PEERS + 1)
+
+typedef struct race {
+  pthread_mutex_t lock;
+  bool stop;                  /* read by the searches without the lock */
+  struct search* winner;      /* the first search to settle the grid,
+				 or NULL */
+} race_t;
+
+typedef struct search {
+  sudoku_ctx_t* ctx;          /* context of its own, with a copy of the grid */
+  race_t* race;
+  pthread_t thread;
+  bool started;               /* the thread could be created */
+  sudoku_status_t status;
+} search_t;
+
+static void*
+search_run (void* arg)
+{
+  search_t* search = arg;
+  race_t* race = search->race;
+
+  search->status = grid_search (search->ctx, search->ctx->grid);
+
+  /*
+   * Only a solution or a proof that there is none settles the grid, a
+   * search which failed otherwise (out of memory) leaves the others
+   * running. A search stopped by the winner comes back after it,
+   * whatever it returned.
+   */
+  if (search->status != SUDOKU_OK && search->status != SUDOKU_UNSOLVABLE)
+    return (NULL);
+  pthread_mutex_lock (&race->lock);
+  if (race->winner == NULL)
+    {
+      race->winner = search;
+      __atomic_store_n (&race->stop, true, __ATOMIC_RELAXED);
+    }
+  pthread_mutex_unlock (&race->lock);
+  return (NULL);
+}
+
+/*
+ * Gives the kth search its own context with a copy of `grid`, or
+ * returns NULL if it runs out of memory
+ */
+static sudoku_ctx_t*
+search_ctx_new (const sudoku_ctx_t* ctx, const pset_t* grid, size_t k)
+{
+  sudoku_ctx_t* search = sudoku_ctx_new ();
+
+  if (search == NULL)
+    return (NULL);
+  if (grid_resize (search, ctx->grid_size) != SUDOKU_OK)
+    {
+      sudoku_ctx_free (search);
+      return (NULL);
+    }
+  memcpy (search->grid, grid,
+	  ctx->grid_size * ctx->grid_size * sizeof (pset_t));
+
+  search->engine = ctx->engine;
+  search->branch = ctx->branch;
+  search->restarts = ctx->restarts;
+  search->learning = ctx->learning;
+  search->probes = ctx->probes;
+  search->hidden_sets = ctx->hidden_sets;
+  search->fish = ctx->fish;
+  search->seed = ctx->seed + k;
+  if (k > 0)
+    {
+      search->engine = SUDOKU_ENGINE_HEURISTICS;
+      search->branch = (k - 1) % BRANCHES;
+      if (search->restarts == 0)
+	search->restarts = SUDOKU_DEFAULT_RESTARTS;
+    }
+  return (search);
+}
+
+sudoku_status_t
+portfolio_search (sudoku_ctx_t* ctx, pset_t* grid, size_t searches)
+{
+  search_t* all = calloc (searches, sizeof (search_t));
+  race_t race = { .stop = false, .winner = NULL };
+  sudoku_status_t status = SUDOKU_OK;
+
+  if (all == NULL)
+    return (error_set (ctx, SUDOKU_ENOMEM, "out of memory!"));
+
+  for (size_t k = 0; k < searches && status == SUDOKU_OK; k++)
+    {
+      all[k].race = &race;
+      all[k].ctx = search_ctx_new (ctx, grid, k);
+      if (all[k].ctx == NULL)
+	status = error_set (ctx, SUDOKU_ENOMEM, "out of memory!");
+      else
+	all[k].ctx->stop = &race.stop;
+    }
+
+  if (status == SUDOKU_OK)
+    {
+      /*
+       * The first search runs in this thread, the others only if their
+       * thread could be created
+       */
+      pthread_mutex_init (&race.lock, NULL);
+      for (size_t k = 1; k < searches; k++)
+	all[k].started = (pthread_create (&all[k].thread, NULL,
+					  &search_run, &all[k]) == 0);
+      search_run (&all[0]);
+      for (size_t k = 1; k < searches; k++)
+	if (all[k].started)
+	  pthread_join (all[k].thread, NULL);
+      pthread_mutex_destroy (&race.lock);
+
+      /* Without a winner every search failed, the first one tells why */
+      search_t* winner = race.winner != NULL ? race.winner : &all[0];
+
+      status = winner->status;
+      if (status == SUDOKU_OK)
+	memcpy (grid, winner->ctx->grid,
+		ctx->grid_size * ctx->grid_size * sizeof (pset_t));
+      else if (status != SUDOKU_UNSOLVABLE)
+	error_set (ctx, status, "%s", sudoku_error (winner->ctx));
+    }
+
+  for (size_t k = 0; k < searches; k++)
+    if (all[k].ctx != NULL)
+      {
+	sudoku_add_stats (&ctx->stats, &all[k].ctx->stats);
+	sudoku_ctx_free (all[k].ctx);
+      }
+  free (all);
+  return (status);
+}
@@ -0,0 +1,17 @@
+#ifndef PORTFOLIO_H
+#define PORTFOLIO_H
+
+/*
+ * Solves `grid` in place like grid_search with `searches` differently
+ * configured searches racing on as many threads. The first search
+ * keeps the configuration of `ctx`, the others restart (with the
+ * restarts of `ctx`, or SUDOKU_DEFAULT_RESTARTS) with their own seed
+ * and go through the branching strategies. The first one to solve the
+ * grid or to prove it unsolvable gives its answer and stops the
+ * others, an error is only returned once every search has failed. The
+ * counters of all the searches are added to the ones of `ctx`.
+ */
+sudoku_status_t portfolio_search (sudoku_ctx_t* ctx, pset_t* grid,
+				  size_t searches);
+
+#endif /* PORTFOLIO_H */
@@ -0,0 +1,27 @@
+#ifndef SIMD9_H
+#define SIMD9_H
+
+/*
+ * The propagation of 9x9 grids on SIMD registers, built on x86-64 with
+ * GCC or Clang unless SUDOKU_NO_SIMD is defined
+ */
+#if defined (__GNUC__) && defined (__x86_64__) && !defined (SUDOKU_NO_SIMD)
+# define SIMD9 1
+#else
+# define SIMD9 0
+#endif
+
+/*
+ * Returns the SIMD propagation of 9x9 grids, which behaves like
+ * grid_heuristics, or NULL if there is none so that the scalar one gets
+ * used. It is the SSE2 instance, measured faster than an AVX2 one
+ */
+heuristics_t simd9_heuristics (void);
+
+/*
+ * Whether the CPU supports AVX2, detected on the first call only, for
+ * the kernels which do run faster on it
+ */
+bool simd9_avx2 (void);
+
+#endif /* SIMD9_H */
@@ -1,439 +1,1075 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 
 #include <preemptive_set.h>
 
 #include "sudoku.h"
 #include "heuristics.h"
-#include "parser.h"
-#include "main.h"
+#include "units.h"
+#include "dlx.h"
 
-static bool random_choice = false;
+typedef struct choice {
+  size_t x;             /* x-coordinate of the changed cell */
+  size_t y;             /* y-coordinate of the changed cell */
+  pset_t choice;        /* storage of the choice we made */
+  size_t trail_mark;    /* length of the trail before the choice */
+  unsigned long epoch;  /* epoch of the level the choice was made in */
+} choice_t;
 
-bool strict = false;
-bool verbose = false;
-char* exec_name;
+/*
+ * The old value of a cell, saved on the trail the first time the
+ * cell changes after a choice
+ */
+typedef struct trail_entry {
+  size_t cell;          /* index of the cell in the grid */
+  pset_t old;
+  deps_t deps;          /* old dependencies of the cell */
+} trail_entry_t;
 
-FILE* output_stream;
+/* Most choices in a learned nogood */
+#define NOGOOD_SIZE 3
+/* Number of nogoods kept, the oldest ones are forgotten first */
+#define NOGOODS_MAX 256
 
-size_t grid_size = 0;
-pset_t** grid;
+/*
+ * Choices which can't all be made together, learned from the
+ * conflicts of the search
+ */
+typedef struct nogood {
+  size_t size;
+  size_t cells[NOGOOD_SIZE];
+  pset_t values[NOGOOD_SIZE];
+} nogood_t;
 
-typedef struct choice {
-  pset_t **grid; /* Original grid */
-  size_t x;      /* x-coordinate of the changed cell */
-  size_t y;      /* y-coordinate of the changed cell */
-  pset_t choice; /* storage of the choice we made */
+/*
+ * Memory reused by all the searches of a context: the stack of
+ * choices and the trail of the cells they changed. It only grows, so
+ * once it is big enough the search doesn't allocate anything.
+ *
+ * Every level of the search gets a new epoch number, `stamps` holds
+ * for each cell the epoch in which its old value was last saved so
+ * that a cell is saved only once per level.
+ *
+ * `deps` holds for each cell the choices its value may depend on, see
+ * cell_set.
+ */
+struct arena {
+  size_t cells;          /* number of cells of the grids */
+  size_t capacity;       /* number of choices that fit */
+  choice_t* choices;
 
-  struct choice *previous; /* Link to the previous choice
-         		    * or NULL if it is the first choice */
-} choice_t;
+  pset_t* grid;          /* grid under search */
+  trail_entry_t* trail;
+  size_t trail_length;
+  size_t trail_capacity;
+  unsigned long* stamps;
+  unsigned long epoch;   /* epoch of the current level */
+  unsigned long epochs;  /* number of epochs given so far */
+  bool failed;           /* the trail could not grow */
+  deps_t* deps;
 
-static void
-stack_print (const choice_t* stack)
+  nogood_t nogoods[NOGOODS_MAX];
+  size_t nogoods_count;
+  size_t nogoods_next;   /* the next one to be replaced */
+};
+
+sudoku_status_t
+error_set (sudoku_ctx_t* ctx, sudoku_status_t status, const char* format, ...)
+{
+  va_list ap;
+
+  va_start (ap, format);
+  vsnprintf (ctx->error, ERROR_MAX, format, ap);
+  va_end (ap);
+
+  return (status);
+}
+
+static sudoku_status_t
+out_of_memory (sudoku_ctx_t* ctx)
+{
+  return (error_set (ctx, SUDOKU_ENOMEM, "out of memory!"));
+}
+
+void
+arena_free (struct arena* arena)
 {
-  if (stack == NULL)
+  if (arena == NULL)
     return;
-  
-   char str1[MAX_COLORS + 1];
-   char str2[MAX_COLORS + 1];
-   pset2str (str1, stack->grid[stack->x][stack->y]);
-   pset2str (str2, stack->choice);
-   if (verbose)
-     grid_print ((const pset_t**) stack->grid);
 
-   fprintf (output_stream,
-	    "Next choice at: grid[%d][%d] = '%s', and choice is = '%s'\n",
-	   (int) stack->x, (int) stack->y, str1, str2);
+  free (arena->choices);
+  free (arena->trail);
+  free (arena->stamps);
+  free (arena->deps);
+  free (arena);
 }
 
-static size_t
-stack_depth (const choice_t* stack)
+/*
+ * Makes sure the arena of the context fits the grids of the context
+ * and at least `depth` + 1 choices
+ */
+static sudoku_status_t
+arena_reserve (sudoku_ctx_t* ctx, size_t depth)
 {
-  if (stack == NULL)
-    return (0);
-  return (1 + stack_depth (stack->previous));
+  size_t cells = ctx->grid_size * ctx->grid_size;
+  struct arena* arena = ctx->arena;
+
+  if (arena != NULL && arena->cells != cells)
+    {
+      arena_free (arena);
+      arena = ctx->arena = NULL;
+    }
+
+  if (arena == NULL)
+    {
+      arena = calloc (1, sizeof (struct arena));
+      if (arena == NULL)
+	return (out_of_memory (ctx));
+      arena->cells = cells;
+      arena->stamps = calloc (cells, sizeof (unsigned long));
+      arena->deps = malloc (cells * sizeof (deps_t));
+      ctx->arena = arena;
+      if (arena->stamps == NULL || arena->deps == NULL)
+	return (out_of_memory (ctx));
+    }
+
+  if (depth < arena->capacity)
+    return (SUDOKU_OK);
+
+  size_t capacity = arena->capacity < 16 ? 16 : 2 * arena->capacity;
+  choice_t* choices = realloc (arena->choices, capacity * sizeof (choice_t));
+
+  if (choices == NULL)
+    return (out_of_memory (ctx));
+  arena->choices = choices;
+  arena->capacity = capacity;
+
+  return (SUDOKU_OK);
 }
 
-static void 
-stack_free (choice_t* stack)
+void
+trail_save (sudoku_ctx_t* ctx, const pset_t* cell)
 {
-  if (stack == NULL)
+  struct arena* arena = ctx->arena;
+  size_t index = cell - arena->grid;
+
+  if (arena->stamps[index] == arena->epoch)
     return;
-  choice_t* prev = stack->previous;
-  
-  grid_free (stack->grid);
-  free (stack);
 
-  return (stack_free (prev));
+  if (arena->trail_length == arena->trail_capacity)
+    {
+      size_t capacity = arena->trail_capacity < 64 ? 64
+	: 2 * arena->trail_capacity;
+      trail_entry_t* trail = realloc (arena->trail,
+				      capacity * sizeof (trail_entry_t));
+      if (trail == NULL)
+	{
+	  arena->failed = true;
+	  return;
+	}
+      arena->trail = trail;
+      arena->trail_capacity = capacity;
+    }
+
+  arena->stamps[index] = arena->epoch;
+  arena->trail[arena->trail_length].cell = index;
+  arena->trail[arena->trail_length].old = *cell;
+  arena->trail[arena->trail_length].deps = arena->deps[index];
+  arena->trail_length++;
 }
 
+/*
+ * Sorts the cells of `grid` in the buckets of the context by counting
+ * their cardinalities
+ */
 static void
-out_of_memory ()
+buckets_fill (sudoku_ctx_t* ctx, pset_t* grid)
 {
-  fprintf (stderr, "%s: error: out of memory!\n", exec_name);
-  usage (EXIT_FAILURE);
+  buckets_t* buckets = &ctx->buckets;
+  size_t cells = ctx->grid_size * ctx->grid_size;
+  uint16_t* start = buckets->start;
+
+  memset (start, 0, sizeof (buckets->start));
+  for (size_t c = 0; c < cells; c++)
+    start[pset_cardinality (grid[c]) + 1]++;
+  for (size_t k = 1; k <= ctx->grid_size + 1; k++)
+    start[k] += start[k - 1];
+  for (size_t c = 0; c < cells; c++)
+    {
+      size_t k = pset_cardinality (grid[c]);
+      size_t p = start[k]++;
+
+      buckets->cells[p] = c;
+      buckets->position[c] = p;
+    }
+  /* Every start went up to the start of the next bucket */
+  memmove (start + 1, start, (ctx->grid_size + 1) * sizeof (uint16_t));
+  start[0] = 0;
+  buckets->grid = grid;
 }
 
-static pset_t**
-grid_copy (const pset_t** grid)
+/*
+ * Prepares the arena of the context for a search on `grid`, which
+ * starts without any choice
+ */
+static sudoku_status_t
+search_start (sudoku_ctx_t* ctx, pset_t* grid)
 {
-  pset_t** new_grid = grid_alloc ();
+  sudoku_status_t status = arena_reserve (ctx, 0);
 
-  for (unsigned int i = 0; i < grid_size; i++)
-    for (unsigned int j = 0; j < grid_size; j++)
-      new_grid[i][j] = grid[i][j];
-  
-  return (new_grid);
+  if (status != SUDOKU_OK)
+    return (status);
+
+  struct arena* arena = ctx->arena;
+
+  arena->grid = grid;
+  arena->trail_length = 0;
+  arena->failed = false;
+  arena->epoch = 0;
+  arena->epochs = 0;
+  memset (arena->stamps, 0, arena->cells * sizeof (unsigned long));
+  memset (arena->deps, 0, arena->cells * sizeof (deps_t));
+  arena->nogoods_count = 0;
+  arena->nogoods_next = 0;
+  ctx->depth = 0;
+  ctx->cause = deps_level (0);
+  ctx->deps = ctx->learning ? arena->deps : NULL;
+  worklist_reset (ctx, grid);
+  buckets_fill (ctx, grid);
+
+  return (SUDOKU_OK);
+}
+
+/*
+ * Ends a search, after which the grid isn't under search anymore and
+ * its changes aren't saved, and returns `ret`
+ */
+static int
+search_stop (sudoku_ctx_t* ctx, int ret)
+{
+  ctx->depth = 0;
+  worklist_clear (ctx);
+  ctx->worklist.grid = NULL;
+  ctx->buckets.grid = NULL;
+  ctx->deps = NULL;
+  return (ret);
+}
+
+static void
+stack_print (const sudoku_ctx_t* ctx, const pset_t* grid, size_t depth)
+{
+  const choice_t* choice = &ctx->arena->choices[depth];
+
+  char str1[MAX_COLORS + 1];
+  char str2[MAX_COLORS + 1];
+  pset2str (str1, grid[choice->x * ctx->grid_size + choice->y]);
+  pset2str (str2, choice->choice);
+  if (ctx->verbose)
+    grid_print (ctx, grid, ctx->output_stream);
+
+  fprintf (ctx->output_stream,
+	   "Next choice at: grid[%d][%d] = '%s', and choice is = '%s'\n",
+	   (int) choice->x, (int) choice->y, str1, str2);
+}
+
+/*
+ * Undoes the changes saved on the trail after the first `mark` ones
+ */
+static void
+trail_restore (sudoku_ctx_t* ctx, pset_t* grid, size_t mark)
+{
+  struct arena* arena = ctx->arena;
+
+  while (arena->trail_length > mark)
+    {
+      const trail_entry_t* entry = &arena->trail[--arena->trail_length];
+
+      buckets_move (&ctx->buckets, entry->cell,
+		    pset_cardinality (grid[entry->cell]),
+		    pset_cardinality (entry->old));
+      grid[entry->cell] = entry->old;
+      arena->deps[entry->cell] = entry->deps;
+    }
 }
 
 /*
  * stack_pop is used for backtracking, it brings the grid passed as an
- * argument to a state where the last choice was made and removes that
- * choice as a possibility
+ * argument to a state where the last choice was made, by undoing the
+ * changes saved on the trail since then, and removes that choice as a
+ * possibility. That the choice was wrong depends on the choices
+ * `conflict` depends on except for the last one.
  */
 
-static choice_t*
-stack_pop (choice_t* stack, pset_t** grid)
+static void
+stack_pop (sudoku_ctx_t* ctx, pset_t* grid, deps_t conflict)
 {
+  struct arena* arena = ctx->arena;
 
-  if (stack == NULL)
-    return (NULL);
-  
-  choice_t* prev = stack->previous; 
+  if (ctx->depth == 0)
+    return;
 
-  stack->grid[stack->x][stack->y] = pset_and (stack->grid[stack->x][stack->y],
-					      pset_negate (stack->choice));
-  
-  for (unsigned int i = 0; i < grid_size; i++)
-    for (unsigned int j = 0; j < grid_size; j++)
-      grid[i][j] = stack->grid[i][j];
+  ctx->depth--;
+  STATS_ADD (ctx, backtracks, 1);
 
-  grid_free (stack->grid);
-  free (stack);
+  const choice_t* choice = &arena->choices[ctx->depth];
+  pset_t* cell = &grid[choice->x * ctx->grid_size + choice->y];
 
-  return (prev);
+  /*
+   * The grid goes back to where the propagation had finished, except
+   * for the cell of the choice
+   */
+  worklist_clear (ctx);
+  trail_restore (ctx, grid, choice->trail_mark);
+  arena->epoch = choice->epoch;
+
+  ctx->cause = deps_level (conflict.lo < ctx->depth ? conflict.lo
+			   : ctx->depth);
+  cell_set (ctx, cell, pset_and (*cell, pset_negate (choice->choice)));
 }
 
 /*
- * stack_push chooses the first cell with the least choice if
- * random_choice is false otherwise it chooses one of the cells with
- * the least choice to be made randomly. Saves the choice in the stack
- * and returns the new stack.
+ * Undoes the choices of the stack above the first `level` ones,
+ * bringing the grid back to where the propagation had finished before
+ * the next one. Unlike stack_pop it doesn't rule out any choice, with
+ * a `level` of 0 the search starts over and keeps only the deductions
+ * made without any choice.
  */
+static void
+stack_backjump (sudoku_ctx_t* ctx, pset_t* grid, size_t level)
+{
+  struct arena* arena = ctx->arena;
+
+  if (ctx->depth <= level)
+    return;
+
+  worklist_clear (ctx);
+  trail_restore (ctx, grid, arena->choices[level].trail_mark);
+  arena->epoch = arena->choices[level].epoch;
+  ctx->depth = level;
+}
 
-static choice_t*
-stack_push (const choice_t* stack, pset_t** grid)
+/*
+ * Learns that the choices `conflict` depends on, the ones of the
+ * levels up to conflict.lo and the one of level conflict.hi, can't be
+ * made together, if there are few enough of them (the first choice
+ * alone is ruled out for good by stack_pop already)
+ */
+static void
+nogood_learn (sudoku_ctx_t* ctx, deps_t conflict)
 {
-  size_t min_cardinality = MAX_COLORS + 1;
-  unsigned int* min_is;
-  unsigned int  min_i = 0;
-  unsigned int* min_js;
-  unsigned int  min_j = 0;
+  struct arena* arena = ctx->arena;
+  size_t size = conflict.lo < conflict.hi ? conflict.lo + 1 : conflict.hi;
 
-  int num_mins = 0;
-  
-  min_is = malloc (grid_size * grid_size * sizeof (unsigned int));
-  min_js = malloc (grid_size * grid_size * sizeof (unsigned int));
+  if (ctx->deps == NULL || conflict.hi < 2 || size > NOGOOD_SIZE)
+    return;
 
-  if (min_js == NULL || min_js == NULL)
-    out_of_memory ();
+  nogood_t* nogood = &arena->nogoods[arena->nogoods_next];
 
-  for (unsigned int i = 0; i < grid_size; i++)
-    for (unsigned int j = 0; j < grid_size; j++)
-      {
-	size_t cdn = pset_cardinality (grid[i][j]);
-	if (!(cdn <= 1) && cdn <= min_cardinality)
-	  {
-	    min_cardinality = cdn;
-	    min_is[num_mins] = i;
-	    min_js[num_mins] = j;
-	    num_mins++;
-	  }
-      }
-  if (random_choice)
+  nogood->size = size;
+  for (size_t k = 0; k < size; k++)
+    {
+      const choice_t* choice = &arena->choices[k < conflict.lo ? k
+					       : conflict.hi - 1];
+
+      nogood->cells[k] = choice->x * ctx->grid_size + choice->y;
+      nogood->values[k] = choice->choice;
+    }
+  arena->nogoods_next = (arena->nogoods_next + 1) % NOGOODS_MAX;
+  if (arena->nogoods_count < NOGOODS_MAX)
+    arena->nogoods_count++;
+  STATS_ADD (ctx, nogoods, 1);
+}
+
+/*
+ * Applies the nogoods to the grid: the last choice of a nogood whose
+ * other choices all hold is ruled out, depending on what they depend
+ * on. Returns 1 if it changed the grid, 2 if all the choices of a
+ * nogood hold (what the conflict depends on is then in ctx->conflict)
+ * and 0 otherwise.
+ */
+static int
+nogoods_apply (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  const struct arena* arena = ctx->arena;
+  int ret = 0;
+
+  for (size_t n = 0; n < arena->nogoods_count; n++)
+    {
+      const nogood_t* nogood = &arena->nogoods[n];
+      size_t open = NOGOOD_SIZE;
+      deps_t deps = deps_level (0);
+      size_t k;
+
+      for (k = 0; k < nogood->size; k++)
+	{
+	  pset_t cell = grid[nogood->cells[k]];
+
+	  if (cell == nogood->values[k])
+	    deps = deps_union (deps, arena->deps[nogood->cells[k]]);
+	  else if (!(cell & nogood->values[k]) || open != NOGOOD_SIZE)
+	    break;
+	  else
+	    open = k;
+	}
+      if (k < nogood->size)
+	continue;
+
+      if (open == NOGOOD_SIZE)
+	{
+	  ctx->conflict = deps;
+	  ret = 2;
+	  break;
+	}
+      pset_t* cell = &grid[nogood->cells[open]];
+
+      ctx->cause = deps;
+      STATS_ADD (ctx, nogood_eliminations, 1);
+      cell_set (ctx, cell, pset_and (*cell, pset_negate (nogood->values[open])));
+      ret = 1;
+    }
+  ctx->cause = deps_level (ctx->depth);
+  return (ret);
+}
+
+/*
+ * The choices the last conflict of the propagation depends on: the
+ * ones it found if the dependencies are tracked, all of them otherwise
+ */
+static deps_t
+conflict_deps (const sudoku_ctx_t* ctx)
+{
+  return (ctx->deps != NULL ? ctx->conflict : deps_level (ctx->depth));
+}
+
+/*
+ * Number of peers of the cell of index `cell` which are not solved yet
+ */
+static size_t
+cell_degree (const sudoku_ctx_t* ctx, const pset_t* grid, size_t cell)
+{
+  const units_t* units = ctx->units;
+  const uint16_t* peers = &units->peers[cell * units->peers_per_cell];
+  size_t degree = 0;
+
+  for (size_t p = 0; p < units->peers_per_cell; p++)
+    if (!pset_is_singleton (grid[peers[p]]))
+      degree++;
+  return (degree);
+}
+
+/*
+ * Chooses the cell to branch on among the cells of the bucket of
+ * cardinality `k`: the first one, or the one with the most unsolved
+ * peers for every strategy but SUDOKU_BRANCH_MRV. When the search
+ * restarts, the ties are broken at random instead.
+ */
+static size_t
+branch_cell (sudoku_ctx_t* ctx, const pset_t* grid, size_t k)
+{
+  const buckets_t* buckets = &ctx->buckets;
+  size_t first = buckets->start[k];
+  size_t best = buckets->cells[first];
+  bool random = (ctx->restarts != 0);
+
+  if (ctx->branch == SUDOKU_BRANCH_MRV)
+    return (random ? buckets->cells[first + random_below (ctx,
+		      buckets->start[k + 1] - first)] : best);
+
+  size_t best_degree = cell_degree (ctx, grid, best);
+  size_t ties = 1;
+
+  for (size_t p = first + 1; p < buckets->start[k + 1]; p++)
+    {
+      size_t degree = cell_degree (ctx, grid, buckets->cells[p]);
+
+      if (degree > best_degree)
+	{
+	  best = buckets->cells[p];
+	  best_degree = degree;
+	  ties = 1;
+	}
+      else if (random && degree == best_degree
+	       && random_below (ctx, ++ties) == 0)
+	best = buckets->cells[p];
+    }
+  return (best);
+}
+
+/*
+ * Chooses the value to try first in the cell of index `cell`: the
+ * leftmost one, or the one held by the fewest (SUDOKU_BRANCH_LCV) or
+ * the most (SUDOKU_BRANCH_PEERS) of its peers, the leftmost one on a
+ * tie. When the search restarts, the ties are broken at random
+ * instead.
+ */
+static pset_t
+branch_value (sudoku_ctx_t* ctx, const pset_t* grid, size_t cell)
+{
+  const units_t* units = ctx->units;
+  const uint16_t* peers = &units->peers[cell * units->peers_per_cell];
+  pset_t candidates = grid[cell];
+  pset_t best = pset_leftmost (candidates);
+  bool random = (ctx->restarts != 0);
+  bool by_peers = (ctx->branch == SUDOKU_BRANCH_LCV
+		   || ctx->branch == SUDOKU_BRANCH_PEERS);
+  size_t best_held = 0;
+  size_t ties = 0;
+
+  if (!by_peers && !random)
+    return (best);
+
+  for (; candidates != 0; candidates ^= pset_leftmost (candidates))
     {
-      min_i = min_is[rand () % num_mins];
-      min_j = min_js[rand () % num_mins];
+      pset_t value = pset_leftmost (candidates);
+      size_t held = 0;
+
+      for (size_t p = 0; by_peers && p < units->peers_per_cell; p++)
+	if (grid[peers[p]] & value)
+	  held++;
+      if (ties == 0
+	  || (ctx->branch == SUDOKU_BRANCH_LCV && held < best_held)
+	  || (ctx->branch == SUDOKU_BRANCH_PEERS && held > best_held))
+	{
+	  best = value;
+	  best_held = held;
+	  ties = 1;
+	}
+      else if (random && held == best_held
+	       && random_below (ctx, ++ties) == 0)
+	best = value;
     }
-  else 
+  return (best);
+}
+
+/*
+ * Failed literal probing: tries each candidate of the first
+ * `ctx->probes` cells of least cardinality (above the singletons) as
+ * if it were a choice, propagates it and undoes it. The first
+ * candidate which leads to a conflict is ruled out, and the function
+ * returns true with its units left to propagate. Returns false if
+ * every candidate it tried holds.
+ */
+static bool
+grid_probe (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  struct arena* arena = ctx->arena;
+  const buckets_t* buckets = &ctx->buckets;
+  size_t depth = ctx->depth;
+  size_t mark = arena->trail_length;
+  unsigned long epoch = arena->epoch;
+  uint16_t cells[MAX_GRID_SIZE];
+  size_t count = buckets->start[ctx->grid_size + 1] - buckets->start[2];
+
+  /*
+   * The probes reorder the buckets, the cells are picked beforehand
+   */
+  if (count > ctx->probes)
+    count = ctx->probes;
+  if (count > MAX_GRID_SIZE)
+    count = MAX_GRID_SIZE;
+  memcpy (cells, &buckets->cells[buckets->start[2]],
+	  count * sizeof (uint16_t));
+
+  for (size_t k = 0; k < count; k++)
     {
-      min_i = min_is[0];
-      min_j = min_js[0];
+      pset_t* cell = &grid[cells[k]];
+
+      for (pset_t candidates = *cell; candidates != 0;
+	   candidates ^= pset_leftmost (candidates))
+	{
+	  pset_t value = pset_leftmost (candidates);
+
+	  /*
+	   * The probe is made one level above the search so that its
+	   * changes are saved on the trail, even without any choice
+	   */
+	  STATS_ADD (ctx, probes, 1);
+	  ctx->depth = depth + 1;
+	  arena->epoch = ++arena->epochs;
+	  ctx->cause = (deps_t) { ctx->depth, 0 };
+	  cell_set (ctx, cell, value);
+
+	  bool failed = (grid_heuristics (ctx, grid) == 2);
+	  deps_t conflict = conflict_deps (ctx);
+
+	  worklist_clear (ctx);
+	  trail_restore (ctx, grid, mark);
+	  arena->epoch = epoch;
+	  ctx->depth = depth;
+	  if (arena->failed)
+	    return (false);
+	  if (!failed)
+	    continue;
+
+	  /*
+	   * Without the probe, the conflict depends on the choices below
+	   * it
+	   */
+	  if (conflict.hi > depth)
+	    conflict = deps_level (conflict.lo < depth ? conflict.lo : depth);
+	  ctx->cause = conflict;
+	  STATS_ADD (ctx, probe_eliminations, 1);
+	  cell_set (ctx, cell, pset_and (*cell, pset_negate (value)));
+	  ctx->cause = deps_level (depth);
+	  return (true);
+	}
     }
+  ctx->cause = deps_level (depth);
+  return (false);
+}
 
-  free (min_js);
-  free (min_is);
-  
-  if (min_cardinality == MAX_COLORS + 1)
-    return ((choice_t*) stack);
+/*
+ * stack_push chooses a cell with the least choice in the lowest bucket
+ * above the singletons, and a value of that cell, following the
+ * branching strategy of the context. Saves the choice on top of the
+ * stack, which is left unchanged if there is no choice to make or if
+ * it runs out of memory.
+ */
 
-  choice_t* our_choice = malloc (sizeof (choice_t));
-  if (our_choice == NULL)
-    out_of_memory ();
+static sudoku_status_t
+stack_push (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  size_t grid_size = ctx->grid_size;
+  const buckets_t* buckets = &ctx->buckets;
+  size_t k = 2;
+  sudoku_status_t status;
 
-  our_choice->grid   = grid_copy ((const pset_t**) grid);
-  our_choice->x      = min_i;
-  our_choice->y      = min_j;
-  our_choice->choice = pset_leftmost (grid[min_i][min_j]);
-  if (verbose)
-    stack_print (our_choice);
-  our_choice->previous = (choice_t*) stack;
+  while (k <= grid_size && buckets->start[k] == buckets->start[k + 1])
+    k++;
+  if (k > grid_size)
+    return (SUDOKU_OK);
 
-  grid[min_i][min_j] = pset_leftmost (grid[min_i][min_j]);
+  if ((status = arena_reserve (ctx, ctx->depth)) != SUDOKU_OK)
+    return (status);
 
-  return (our_choice);
-}  
+  struct arena* arena = ctx->arena;
+  size_t index = branch_cell (ctx, grid, k);
+  choice_t* our_choice = &arena->choices[ctx->depth];
+  pset_t* cell = &grid[index];
+
+  our_choice->x          = index / grid_size;
+  our_choice->y          = index % grid_size;
+  our_choice->choice     = branch_value (ctx, grid, index);
+  our_choice->trail_mark = arena->trail_length;
+  our_choice->epoch      = arena->epoch;
+  if (ctx->verbose)
+    stack_print (ctx, grid, ctx->depth);
+
+  ctx->depth++;
+  STATS_ADD (ctx, decisions, 1);
+  STATS_MAX (ctx, max_depth, ctx->depth);
+  arena->epoch = ++arena->epochs;
+  ctx->cause = (deps_t) { ctx->depth, 0 };
+  cell_set (ctx, cell, our_choice->choice);
+
+  return (SUDOKU_OK);
+}
 
 /*
- * Given a grid, number_of_solutions tries solving it and when it
- * arrives to a solution then it backtracks and tries to find other
- * solutions while counting the number of them, this number is
- * returned in the end
+ * Given a grid, grid_count tries solving it and when it arrives to a
+ * solution then it backtracks and tries to find other solutions while
+ * counting them, until it has found `limit` of them
  */
 
-static int
-number_of_solutions (pset_t** grid)
+sudoku_status_t
+grid_count (sudoku_ctx_t* ctx, pset_t* grid, unsigned long limit,
+	    unsigned long* count)
 {
-  choice_t* stack = NULL;
-  int sols = 0;
-  
+  sudoku_status_t status;
+
+  *count = 0;
+  if (ctx->engine == SUDOKU_ENGINE_DLX)
+    return (dlx_count (ctx, grid, limit, count));
+
+  if ((status = search_start (ctx, grid)) != SUDOKU_OK)
+    return (status);
+
   for (;;)
     {
-      switch (grid_heuristics (grid))
+      int heuristics = grid_heuristics (ctx, grid);
+      deps_t conflict;
+
+      if (ctx->arena->failed)
+	return (search_stop (ctx, out_of_memory (ctx)));
+
+      switch (heuristics)
 	{
 	case 0:
-	  sols++;
-	  if (stack == NULL)
-	    {
-	      stack_free (stack);
-	      return (sols);
-	    }
-	  else
-	    {
-	      stack = stack_pop (stack, grid);
-	      break;
-	    }
+	  (*count)++;
+	  if (ctx->depth == 0 || *count == limit)
+	    return (search_stop (ctx, SUDOKU_OK));
+	  stack_pop (ctx, grid, deps_level (ctx->depth));
+	  break;
 	case 1:
-	  stack = stack_push (stack, grid);
+	  if (ctx->probes != 0 && grid_probe (ctx, grid))
+	    break;
+	  if ((status = stack_push (ctx, grid)) != SUDOKU_OK)
+	    return (search_stop (ctx, status));
 	  break;
 	case 2:
-	  if (stack == NULL)
-	    {
-	      return (sols);
-	    }
-	  stack = stack_pop (stack, grid);
+	  conflict = conflict_deps (ctx);
+	  if (conflict.hi == 0)
+	    return (search_stop (ctx, SUDOKU_OK));
+	  STATS_ADD (ctx, backjumps, ctx->depth - conflict.hi);
+	  stack_backjump (ctx, grid, conflict.hi);
+	  stack_pop (ctx, grid, conflict);
 	  break;
 	}
     }
 }
 
+/*
+ * The ith term of the Luby sequence 1 1 2 1 1 2 4 1 1 2 1 1 2 4 8...,
+ * counting from 1
+ */
+static unsigned long
+luby (unsigned long i)
+{
+  for (;;)
+    {
+      unsigned long k = 1;
+
+      while (((1UL << k) - 1) < i)
+	k++;
+      if (i == (1UL << k) - 1)
+	return (1UL << (k - 1));
+      i -= (1UL << (k - 1)) - 1;
+    }
+}
+
 /*
  * Tries solving the grid with heuristics and when they don't work it
- * guesses a cell with stack_push
+ * guesses a cell with stack_push.
+ *
+ * When the dependencies of the cells are tracked, a conflict only
+ * undoes the choices it depends on: the search jumps back over the
+ * choices above the last one of them, then rules that one out. The
+ * conflicts which depend on few enough choices are learned as nogoods.
+ *
+ * With restarts, the ith run of the search gives up after
+ * `restarts` * luby (i) dead ends and the next one starts over from the
+ * first choice, keeping what the previous runs proved without any
+ * choice. The runs grow without bound so the search stays complete.
  */
 
-bool 
-grid_solver (pset_t** grid)
+static sudoku_status_t
+heuristics_search (sudoku_ctx_t* ctx, pset_t* grid)
 {
-  choice_t* stack = NULL;
-  
+  sudoku_status_t status = search_start (ctx, grid);
+  unsigned long run = 1;
+  unsigned long dead_ends = ctx->restarts;
+
+  if (status != SUDOKU_OK)
+    return (status);
+
   for (;;)
     {
-      switch (grid_heuristics (grid))
+      if (search_stopped (ctx))
+	return (search_stop (ctx, SUDOKU_UNSOLVABLE));
+
+      int heuristics = grid_heuristics (ctx, grid);
+      deps_t conflict;
+
+      /*
+       * The nogoods are only looked at once the heuristics are stuck,
+       * what they rule out is propagated again
+       */
+      if (heuristics == 1 && ctx->deps != NULL)
+	switch (nogoods_apply (ctx, grid))
+	  {
+	  case 1:
+	    if (ctx->arena->failed)
+	      return (search_stop (ctx, out_of_memory (ctx)));
+	    continue;
+	  case 2:
+	    heuristics = 2;
+	    break;
+	  }
+
+      /*
+       * So are the probes, before the search makes a choice
+       */
+      if (heuristics == 1 && ctx->probes != 0 && grid_probe (ctx, grid))
+	continue;
+
+      if (ctx->arena->failed)
+	return (search_stop (ctx, out_of_memory (ctx)));
+
+      switch (heuristics)
 	{
 	case 0:
-	  if (!random_choice) 
-	    {
-	      fprintf (output_stream, "Grid has been solved\n");
-	      grid_print ((const pset_t**) grid);
-	    }
-	  stack_free (stack);
-	  return (true);
+	  return (search_stop (ctx, SUDOKU_OK));
 	case 1:
-	  stack = stack_push (stack, grid);
+	  if ((status = stack_push (ctx, grid)) != SUDOKU_OK)
+	    return (search_stop (ctx, status));
 	  break;
 	case 2:
-	  if (stack == NULL)
+	  conflict = conflict_deps (ctx);
+	  if (conflict.hi == 0)
+	    return (search_stop (ctx, SUDOKU_UNSOLVABLE));
+	  nogood_learn (ctx, conflict);
+	  if (ctx->restarts != 0 && --dead_ends == 0)
+	    {
+	      stack_backjump (ctx, grid, 0);
+	      STATS_ADD (ctx, restarts, 1);
+	      dead_ends = ctx->restarts * luby (++run);
+	    }
+	  else
 	    {
-	      if (!random_choice)
-		fprintf (output_stream, "Grid could not be solved\n");
-	      return (false);
+	      STATS_ADD (ctx, backjumps, ctx->depth - conflict.hi);
+	      stack_backjump (ctx, grid, conflict.hi);
+	      stack_pop (ctx, grid, conflict);
 	    }
-	  stack = stack_pop (stack, grid);
 	  break;
 	}
     }
 }
 
+sudoku_status_t
+grid_search (sudoku_ctx_t* ctx, pset_t* grid)
+{
+  if (ctx->engine == SUDOKU_ENGINE_DLX)
+    return (dlx_solve (ctx, grid));
+  return (heuristics_search (ctx, grid));
+}
+
 /*
  * shuffles the elements on the array `arr` (of size `size`)
  * in a random permutation
  */
 static void
-shuffle (int* const arr, int size)
+shuffle (sudoku_ctx_t* ctx, int* const arr, int size)
 {
-  srand (time (NULL));
-
   for (int i = 0; i < size - 1; i++)
     {
-      int r  = i + (rand () % (size - i));
+      int r  = i + random_below (ctx, size - i);
       int t  = arr[i];
       arr[i] = arr[r];
       arr[r] = t;
     }
 }
 
+/*
+ * Fills `perm` with a random order of the rows (or columns) of the
+ * grid which keeps them in their bands (or stacks) of `block` rows
+ */
+static void
+shuffle_bands (sudoku_ctx_t* ctx, int* const perm, int block)
+{
+  int bands[block], inner[block];
+
+  for (int k = 0; k < block; k++)
+    bands[k] = k;
+  shuffle (ctx, bands, block);
+  for (int b = 0; b < block; b++)
+    {
+      for (int k = 0; k < block; k++)
+	inner[k] = k;
+      shuffle (ctx, inner, block);
+      for (int k = 0; k < block; k++)
+	perm[b * block + k] = bands[b] * block + inner[k];
+    }
+}
+
 void
-generate_grid (int size)
+grid_fill (sudoku_ctx_t* ctx, pset_t* grid)
 {
-  check_size_of_grid (size, NULL);
+  int size = ctx->grid_size;
+  int block = ctx->units->block_size;
+  int rows[size], cols[size], values[size];
+  bool transpose = random_below (ctx, 2);
+
+  for (int k = 0; k < size; k++)
+    values[k] = k;
+  shuffle (ctx, values, size);
+  shuffle_bands (ctx, rows, block);
+  shuffle_bands (ctx, cols, block);
+
+  for (int i = 0; i < size; i++)
+    for (int j = 0; j < size; j++)
+      {
+	int r = transpose ? cols[j] : rows[i];
+	int c = transpose ? rows[i] : cols[j];
+
+	grid[i * size + j] =
+	  (pset_t) 1 << values[(block * (r % block) + r / block + c) % size];
+      }
+}
+
+sudoku_status_t
+generate_grid (sudoku_ctx_t* ctx, int size)
+{
+  if (!valid_grid_size (size))
+    return (error_set (ctx, SUDOKU_ESIZE, "wrong grid size: %d", size));
 
   int num_elements = size * size;
   int empty_cells;
+  sudoku_status_t status = SUDOKU_OK;
+
+  if ((status = grid_resize (ctx, size)) != SUDOKU_OK)
+    return (status);
+
+  size_t grid_size = ctx->grid_size;
+  pset_t* grid = ctx->grid;
+
+  grid_fill (ctx, grid);
 
-  grid_size = size;
-  grid = grid_alloc ();
-  
-  for (unsigned int i = 0; i < grid_size; i++)
-    for (unsigned int j = 0; j < grid_size; j++)
-      grid[i][j] = pset_full (grid_size);
-      
-  random_choice = true; 
-  srand (time (NULL));
-  
-  grid_solver (grid);
-  
   int* arr = malloc (num_elements * (sizeof (int)));
 
   if (arr == NULL)
-    out_of_memory ();
+    return (out_of_memory (ctx));
 
   for (int i = 0; i < num_elements; i++)
     arr[i] = i;
-  shuffle (arr, num_elements);
-  
-  if (strict)
+  shuffle (ctx, arr, num_elements);
+
+  if (ctx->strict)
     {
-      for (int i = 0; i < num_elements; i++)
+      /*
+       * The cells left still hold the solution. The grid keeps it as
+       * its only solution without one of them if no solution has
+       * another value in that cell, which a single search on a copy of
+       * the grid where the value is barred from the cell tells.
+       */
+      pset_t* test = grid_alloc (ctx);
+
+      if (test == NULL)
+	status = out_of_memory (ctx);
+      for (int i = 0; i < num_elements && status == SUDOKU_OK; i++)
 	{
-	  pset_t tmp = grid[arr[i] / grid_size][arr[i] % grid_size];
-	  grid[arr[i] / grid_size][arr[i] % grid_size] = pset_full (grid_size);
+	  memcpy (test, grid, num_elements * sizeof (pset_t));
+	  test[arr[i]] = pset_and (pset_full (grid_size),
+				   pset_negate (grid[arr[i]]));
 
-	  pset_t** orig1 = grid_copy ((const pset_t**) grid);
-	  pset_t** orig2 = grid_copy ((const pset_t**) grid);
-	  
-	  if (grid_heuristics (orig1) != 0 && number_of_solutions (orig2) != 1)
+	  status = grid_search (ctx, test);
+	  if (status == SUDOKU_UNSOLVABLE)
 	    {
-	      grid[arr[i] / grid_size][arr[i] % grid_size] = tmp;
-	      break;
+	      grid[arr[i]] = pset_full (grid_size);
+	      status = SUDOKU_OK;
 	    }
-	  grid_free (orig1);
-	  grid_free (orig2);
+	  else if (status == SUDOKU_OK)
+	    break;
 	}
+      grid_free (test);
     }
   else
     {
       empty_cells = (2 * num_elements) / 3;
 
       for (int i = 0; i < empty_cells; i++)
-	{
-	  grid[arr[i] / grid_size][arr[i] % grid_size] =
-	    pset_full (grid_size);
-	}
+	grid[arr[i]] = pset_full (grid_size);
     }
-  
+
   free (arr);
-  grid_print ((const pset_t**) grid);
-  grid_free (grid);
+  return (status);
 }
 
-void
-grid_free (pset_t** grid)
+sudoku_status_t
+grid_resize (sudoku_ctx_t* ctx, size_t size)
 {
-  if  (grid == NULL)
-    return;
+  if (ctx->grid != NULL && size == ctx->grid_size)
+    return (SUDOKU_OK);
 
-  for (unsigned int i = 0; i < grid_size; i++)
-    free (grid[i]);
+  grid_free (ctx->grid);
+  ctx->grid_size = size;
+  ctx->units = units_get (size);
+  ctx->heuristics = heuristics_kernel (size);
+  ctx->grid = ctx->units != NULL ? grid_alloc (ctx) : NULL;
+  if (ctx->grid == NULL)
+    {
+      ctx->grid_size = 0;
+      return (out_of_memory (ctx));
+    }
+  return (SUDOKU_OK);
+}
 
+void
+grid_free (pset_t* grid)
+{
   free (grid);
 }
 
-pset_t**
-grid_alloc (void)
+pset_t*
+grid_alloc (const sudoku_ctx_t* ctx)
 {
-  pset_t** ret;
+  size_t bytes = ctx->grid_size * ctx->grid_size * sizeof (pset_t);
+  pset_t* ret;
 
-  ret = calloc (grid_size, sizeof (pset_t*));
-  if (ret == NULL)
-    out_of_memory ();
-  for (unsigned int i = 0; i < grid_size; i++)
-    {
-      ret[i] = calloc (grid_size, sizeof (pset_t));
-      if (ret[i] == NULL)
-	out_of_memory ();
-    }
+  if (posix_memalign ((void**) &ret, GRID_ALIGNMENT, bytes) != 0)
+    return (NULL);
+  memset (ret, 0, bytes);
   return (ret);
 }
 
 void
-grid_print (const pset_t** grid)
+grid_print (const sudoku_ctx_t* ctx, const pset_t* grid, FILE* out)
 {
+  size_t grid_size = ctx->grid_size;
   char str[MAX_COLORS+1] = {0};
   size_t max_cardinality = 0;
 
-  if (grid_size == 1 && !random_choice)
+  if (grid_size == 1)
     {
-      pset2str (str,grid[0][0]);
-      fprintf (output_stream, "%s\n", str);
+      pset2str (str,grid[0]);
+      fprintf (out, "%s\n", str);
       return;
     }
-  
+
   for (unsigned int i = 0; i < grid_size; i++)
     for (unsigned int j = 0; j < grid_size; j++)
       {
-	if (pset_cardinality (grid[i][j]) > max_cardinality
-	    && grid[i][j] != pset_full (grid_size))
-	  max_cardinality = pset_cardinality(grid[i][j]);
+	if (pset_cardinality (grid[i * grid_size + j]) > max_cardinality
+	    && grid[i * grid_size + j] != pset_full (grid_size))
+	  max_cardinality = pset_cardinality(grid[i * grid_size + j]);
       }
-  
+
   for (unsigned int i = 0; i < grid_size; i++)
     {
       for (unsigned int j = 0; j < grid_size; j++)
 	{
 	  size_t spaces_length;
-	  
-	  if (grid[i][j] == pset_full (grid_size))
+	  pset_t cell = grid[i * grid_size + j];
+
+	  if (cell == pset_full (grid_size))
 	    {
 	      spaces_length = max_cardinality;
-	      fprintf (output_stream, "_");
+	      fprintf (out, "_");
 	    }
-	  else 
+	  else
 	    {
-	      spaces_length = max_cardinality - pset_cardinality(grid[i][j]);
+	      spaces_length = max_cardinality - pset_cardinality(cell);
 
-	      pset2str (str, grid[i][j]);
-	      fprintf (output_stream, "%s ", str);
+	      pset2str (str, cell);
+	      fprintf (out, "%s ", str);
 	    }
 	  for (;spaces_length > 0; spaces_length--)
-	    fputc (' ', output_stream);
+	    fputc (' ', out);
 	}
-      fprintf (output_stream, "\n");
+      fprintf (out, "\n");
     }
 }
 
 void
-check_size_of_grid (int s, FILE *in)
+grid_to_line (const sudoku_ctx_t* ctx, const pset_t* grid, char line[])
 {
-  if (s != 1  && s != 4  && s != 9  && s != 16 &&
-      s != 25 && s != 36 && s != 49 && s != 64)
+  size_t cells = ctx->grid_size * ctx->grid_size;
+  char str[MAX_COLORS + 1];
+
+  for (unsigned int k = 0; k < cells; k++)
     {
-      if (in != NULL)
-	fclose (in);
-      fprintf (stderr, "Wrong grid size: %d\n", s);
-      usage (EXIT_FAILURE);
+      pset2str (str, grid[k]);
+      line[k] = pset_is_singleton (grid[k]) ? str[0] : '.';
     }
+  line[cells] = '\0';
 }
 
+bool
+valid_grid_size (int s)
+{
+  return (s == 1  || s == 4  || s == 9  || s == 16 ||
+	  s == 25 || s == 36 || s == 49 || s == 64);
+}
@@ -1,6 +1,8 @@
 #ifndef SUDOKU_H
 #define SUDOKU_H
 
+#include <libsudoku.h>
+
 #define PROG_NAME "sudoku"
 
 #define PROG_VERSION    1
@@ -8,58 +10,387 @@
 #define PROG_REVISION   0
 
 #define MAX_GRID_SIZE 64
+#define MAX_BLOCK_SIZE 8
+
+/* Maximum length of the error messages kept in the context */
+#define ERROR_MAX 128
+
+/* Grids are aligned on cache lines */
+#define GRID_ALIGNMENT 64
+
+/*
+ * The stages of the propagation, from the cheapest to the most
+ * expensive, see grid_heuristics. The singles (cross-hatching and lone
+ * number) always run, the scheduling may skip the other stages.
+ */
+typedef enum stage {
+  STAGE_SINGLES,
+  STAGE_LOCKED_CANDIDATES,
+  STAGE_NAKED_SETS,
+  STAGE_HIDDEN_SETS,
+  STAGE_FISH,
+  STAGES
+} stage_t;
+
+/*
+ * How a stage has fared since the propagation of the grid under search
+ * started, which the scheduling of the stages goes by
+ */
+typedef struct schedule {
+  unsigned long runs;
+  unsigned long work;    /* estimate of the cells looked at */
+  unsigned int backoff;  /* runs skipped after the last fruitless one */
+  unsigned int skip;     /* runs left to skip */
+} schedule_t;
+
+/*
+ * Units (rows, columns and blocks) of the grid under search whose
+ * cells changed since the propagation last looked at them. Rows are
+ * numbered from 0, columns from grid_size and blocks from
+ * 2 * grid_size. The queue is the one of the singles, the other
+ * stages keep a bit of `pending` per unit, and the fish a bit of
+ * `grid_pending` for the whole grid.
+ */
+typedef struct worklist {
+  pset_t* grid;          /* grid under search, or NULL */
+  size_t units;          /* 3 * grid_size */
+  unsigned int queue[3 * MAX_GRID_SIZE];  /* ring of the dirty units */
+  size_t head;
+  size_t length;
+  bool queued[3 * MAX_GRID_SIZE];
+  uint8_t pending[3 * MAX_GRID_SIZE];     /* stages due for each unit */
+  uint8_t grid_pending;                   /* stages due for the grid */
+  schedule_t schedule[STAGES];
+} worklist_t;
+
+/*
+ * The cells of the grid under search sorted by cardinality, a bucket
+ * queue which cell_set keeps up to date. The cells of cardinality k
+ * are cells[start[k]] to cells[start[k + 1] - 1], so that the search
+ * finds a cell with the least choice without looking at the grid.
+ */
+typedef struct buckets {
+  pset_t* grid;          /* grid under search, or NULL */
+  uint16_t cells[MAX_GRID_SIZE * MAX_GRID_SIZE];
+  uint16_t position[MAX_GRID_SIZE * MAX_GRID_SIZE];  /* index of each
+							 cell in cells */
+  uint16_t start[MAX_GRID_SIZE + 2];
+} buckets_t;
+
+/*
+ * The choices of the search a cell (or a conflict) may depend on,
+ * summed up by two levels: it depends at most on the choice of level
+ * `hi` and on the choices of the levels up to `lo`, with lo <= hi.
+ * Level 0 stands for no choice at all.
+ */
+typedef struct deps {
+  uint32_t hi;
+  uint32_t lo;
+} deps_t;
+
+/*
+ * An instance of the propagation of the heuristics, see
+ * grid_heuristics
+ */
+typedef int (*heuristics_t) (sudoku_ctx_t* ctx, pset_t* grid);
+
+/*
+ * The whole state of a solver, no function of the library uses
+ * global variables so that independent contexts can be used at the
+ * same time.
+ */
+struct sudoku_ctx {
+  size_t grid_size;     /* assigned when a grid is parsed, 0 before */
+  pset_t* grid;         /* the grid being solved row after row, or NULL */
+  const struct units* units;  /* tables of the units of the grid size */
+  heuristics_t heuristics;    /* propagation specialized for the size */
+
+  bool verbose;         /* print the progress of the solver */
+  bool strict;          /* generate grids with only one solution */
+  FILE* output_stream;  /* verbose messages are written to it */
+  uint64_t seed;        /* state of the random number generator */
+  sudoku_engine_t engine;     /* search used by grid_search */
+  sudoku_branch_t branch;     /* choices of the heuristics engine */
+  unsigned long restarts;     /* dead ends of the first run of the
+				 heuristics engine, 0 not to restart */
+  const bool* stop;     /* the searches give up once it is true, it may
+			   be set by another thread, or NULL */
+  bool learning;        /* backjump and learn nogoods */
+  size_t probes;        /* cells probed before each choice, 0 not to
+			   probe */
+  bool hidden_sets;     /* look for hidden pairs and triples */
+  bool fish;            /* look for X-Wings and Swordfish */
+  deps_t* deps;         /* dependencies of each cell of the grid under
+			   search, NULL when they aren't tracked */
+  deps_t cause;         /* dependencies of the changes being made */
+  deps_t conflict;      /* dependencies of the last conflict found by
+			   the propagation */
+  struct arena* arena;  /* memory reused by the searches */
+  struct dlx* dlx;      /* links of the exact cover search */
+  size_t depth;         /* number of choices made by the search */
+  worklist_t worklist;  /* units left to propagate */
+  buckets_t buckets;    /* cells of the grid under search by cardinality */
+  sudoku_stats_t stats;
+
+  char error[ERROR_MAX];
+};
+
+/*
+ * Updates the counters of the statistics of the context, they compile
+ * to nothing (without evaluating their arguments) when SUDOKU_NO_STATS
+ * is defined
+ */
+#ifndef SUDOKU_NO_STATS
+# define STATS_ADD(ctx, counter, n) ((ctx)->stats.counter += (n))
+# define STATS_MAX(ctx, counter, n)					\
+  ((ctx)->stats.counter = (n) > (ctx)->stats.counter ? (n)		\
+   : (ctx)->stats.counter)
+#else
+# define STATS_ADD(ctx, counter, n) ((void) 0)
+# define STATS_MAX(ctx, counter, n) ((void) 0)
+#endif
+
+/*
+ * Returns true if the searches of the context have been told to give up
+ */
+static inline bool
+search_stopped (const sudoku_ctx_t* ctx)
+{
+  return (ctx->stop != NULL && __atomic_load_n (ctx->stop, __ATOMIC_RELAXED));
+}
+
+/*
+ * Returns a random number below `n` from the generator of the context,
+ * a splitmix64 whose whole state is the seed so that contexts can be
+ * seeded independently
+ */
+static inline size_t
+random_below (sudoku_ctx_t* ctx, size_t n)
+{
+  uint64_t z = (ctx->seed += 0x9e3779b97f4a7c15);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return ((z ^ (z >> 31)) % n);
+}
+
+/*
+ * Returns a seed for the contexts which are not given one, the clock
+ * nanoseconds and the process id mixed through splitmix64 so that runs
+ * started in the same second or in parallel differ
+ */
+uint64_t seed_default (void);
+
+/*
+ * Formats the message of the error `status` in the context, printf
+ * style, and returns `status`
+ */
+sudoku_status_t error_set (sudoku_ctx_t* ctx, sudoku_status_t status,
+			   const char* format, ...);
 
 /*
- * Prints the grid given as argument, while also handling the
+ * Prints the grid given as argument on `out`, while also handling the
  * alignment of columns. Prints '_' in case of a full pset.
  */
- 
-void grid_print (const pset_t** grid);
+void grid_print (const sudoku_ctx_t* ctx, const pset_t* grid, FILE* out);
 
 /*
- * Checks the size of the grid if it's a square of a integer and less
- * then the specified maximum grid. You pass the as a second parameter
- * the input file you want to close in case of a wrong grid size, or
- * NULL otherwise
+ * Writes the grid on the single line `line` (which must hold at least
+ * `grid_size * grid_size + 1` characters) in the format read by
+ * `grid_parse_line`, with '.' for the cells that are not singletons.
  */
-void check_size_of_grid (int s, FILE *in);
+void grid_to_line (const sudoku_ctx_t* ctx, const pset_t* grid,
+		   char line[]);
 
-/* All non-error messages are written to this stream */
-extern FILE* output_stream;
-/* The name of the exectuable taken from argv[0] */
-extern char* exec_name;
-/* Verbosity and strictness flag, are true in case of such options given */
-extern bool verbose;
-extern bool strict;
+/*
+ * Returns true if `s` is a supported grid size, that is the square
+ * of an integer not greater than the specified maximum grid.
+ */
+bool valid_grid_size (int s);
+
+/*
+ * Tries allocating memory for a grid of `grid_size` size, in one
+ * block aligned on a cache line. Returns NULL if it can't. The cell
+ * (i, j) of a grid is at index i * grid_size + j.
+ */
+pset_t* grid_alloc (const sudoku_ctx_t* ctx);
+
+/*
+ * Replaces the grid of the context by a new one of size `size`, which
+ * must be valid, and looks up the unit tables of that size. Keeps the
+ * grid if it already has that size.
+ */
+sudoku_status_t grid_resize (sudoku_ctx_t* ctx, size_t size);
+
+/*
+ * Frees the grid, in case of a NULL argument it does nothing
+ */
+void grid_free (pset_t* grid);
+
+/*
+ * Frees the memory used by the searches of a context, in case of a
+ * NULL argument it does nothing
+ */
+void arena_free (struct arena* arena);
+
+/*
+ * Saves the value of `cell`, which belongs to the grid under search,
+ * on the trail of the context so that it can be restored when the
+ * search backtracks
+ */
+void trail_save (sudoku_ctx_t* ctx, const pset_t* cell);
+
+/*
+ * Queues the units of the cell of index `cell` of the grid under
+ * search for propagation
+ */
+void worklist_mark (sudoku_ctx_t* ctx, size_t cell);
+
+/*
+ * Moves the cell of index `cell` from the bucket of cardinality `from`
+ * to the one of cardinality `to`, one bucket at a time: the cell is
+ * swapped with the first (or last) cell of its bucket and the bound
+ * between the two buckets moves past it
+ */
+static inline void
+buckets_move (buckets_t* buckets, size_t cell, size_t from, size_t to)
+{
+  uint16_t* cells = buckets->cells;
+  uint16_t* position = buckets->position;
+
+  for (; from > to; from--)
+    {
+      uint16_t other = cells[buckets->start[from]];
+      uint16_t k = position[cell];
 
-/* 
- * These values get assigned after the grid is parsed after which time
- * they won't be assigned to
- */ 
-extern size_t grid_size;
-extern pset_t** grid; 
+      cells[k] = other;
+      position[other] = k;
+      cells[buckets->start[from]] = cell;
+      position[cell] = buckets->start[from]++;
+    }
+  for (; from < to; from++)
+    {
+      uint16_t other = cells[buckets->start[from + 1] - 1];
+      uint16_t k = position[cell];
+
+      cells[k] = other;
+      position[other] = k;
+      cells[buckets->start[from + 1] - 1] = cell;
+      position[cell] = --buckets->start[from + 1];
+    }
+}
 
 /*
- * Tries allocating memory for a grid of `grid_size` size exits the
- * program if it can't
+ * The dependencies on all the choices up to the one of level `level`
  */
-pset_t** grid_alloc (void);
+static inline deps_t
+deps_level (uint32_t level)
+{
+  return ((deps_t) { level, level });
+}
 
 /*
- * Frees the grid, in case of a NULL argument it does nothing 
+ * The dependencies of what depends on both `a` and `b`
  */
-void grid_free (pset_t** grid);
+static inline deps_t
+deps_union (deps_t a, deps_t b)
+{
+  if (a.hi < b.hi)
+    {
+      deps_t t = a;
+
+      a = b;
+      b = t;
+    }
+  if (a.hi == b.hi)
+    return ((deps_t) { a.hi, a.lo > b.lo ? a.lo : b.lo });
+  return ((deps_t) { a.hi, a.lo > b.hi ? a.lo : b.hi });
+}
 
 /*
- * Tries solving the grid and returns true if it succeeds and false
- * otherwise (which would mean that the grid is inconsistent and
- * unsolvable.
+ * The dependencies of the cells of `unit`, which must be tracked
+ */
+static inline deps_t
+unit_deps (const sudoku_ctx_t* ctx, const uint16_t* unit)
+{
+  deps_t deps = { 0, 0 };
+
+  for (size_t i = 0; i < ctx->grid_size; i++)
+    deps = deps_union (deps, ctx->deps[unit[i]]);
+  return (deps);
+}
+
+/*
+ * Makes the changes that follow depend on the cells of `unit`. Does
+ * nothing when the dependencies aren't tracked.
+ */
+static inline void
+cause_unit (sudoku_ctx_t* ctx, const uint16_t* unit)
+{
+  if (ctx->deps != NULL)
+    ctx->cause = unit_deps (ctx, unit);
+}
+
+/*
+ * Assigns `value` to `cell`. Every change to a grid goes through it so
+ * that, once a choice has been made, the old value of the cell is
+ * saved on the trail, that its units get propagated again and that
+ * it moves to the bucket of its new cardinality.
+ *
+ * The value of a cell depends on the choices its changes depend on:
+ * every change adds the cause of the context, the dependencies of the
+ * cells it was deduced from (or the choice itself), to the ones of the
+ * cell.
+ */
+static inline void
+cell_set (sudoku_ctx_t* ctx, pset_t* cell, pset_t value)
+{
+  if (*cell == value)
+    return;
+  if (ctx->depth > 0)
+    trail_save (ctx, cell);
+  if (ctx->buckets.grid != NULL)
+    {
+      size_t index = cell - ctx->buckets.grid;
+
+      buckets_move (&ctx->buckets, index,
+		    pset_cardinality (*cell), pset_cardinality (value));
+      if (ctx->deps != NULL)
+	ctx->deps[index] = deps_union (ctx->deps[index], ctx->cause);
+    }
+  *cell = value;
+  if (ctx->worklist.grid != NULL)
+    worklist_mark (ctx, cell - ctx->worklist.grid);
+}
+
+/*
+ * Tries solving the grid, leaving the solution in `grid`, and returns
+ * SUDOKU_OK if it succeeds and SUDOKU_UNSOLVABLE otherwise (which
+ * would mean that the grid is inconsistent and unsolvable). The search
+ * is the engine of the context, see dlx.h.
  * While generate_grid generates a grid of size `size`
  * makes it a grid with only one possible solution if the strict flag
  * is true
  */
+sudoku_status_t grid_search (sudoku_ctx_t* ctx, pset_t* grid);
+sudoku_status_t generate_grid (sudoku_ctx_t* ctx, int size);
 
-bool grid_solver (pset_t** grid);
-void generate_grid (int size);
+/*
+ * Fills the grid with a random solved grid, built without any search:
+ * the cell (r, c) of the pattern holds the value
+ * (block * (r % block) + r / block + c) % size, which is solved, and
+ * its values, bands, stacks, rows, columns and diagonal are shuffled,
+ * which keeps it solved. generate_grid then empties some of its cells.
+ */
+void grid_fill (sudoku_ctx_t* ctx, pset_t* grid);
+
+/*
+ * Counts the solutions of `grid` in `count` and stops as soon as it
+ * has found `limit` of them, or never if `limit` is 0. The grid is
+ * left in no particular state. Returns SUDOKU_OK, or SUDOKU_ENOMEM if
+ * it runs out of memory.
+ */
+sudoku_status_t grid_count (sudoku_ctx_t* ctx, pset_t* grid,
+			    unsigned long limit, unsigned long* count);
 
 #endif /* SUDOKU_H */
@@ -0,0 +1,134 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <preemptive_set.h>
+
+#include "sudoku.h"
+#include "units.h"
+
+/* Tables of every grid size, indexed by the block size */
+static units_t* tables[MAX_BLOCK_SIZE + 1];
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+units_free (units_t* units)
+{
+  if (units == NULL)
+    return;
+
+  free (units->unit_cells);
+  free (units->cell_units);
+  free (units->peers);
+  free (units->block_row);
+  free (units->block_col);
+  free (units);
+}
+
+static units_t*
+units_build (size_t grid_size)
+{
+  units_t* units = calloc (1, sizeof (units_t));
+  size_t block_size = 0;
+
+  if (units == NULL)
+    return (NULL);
+
+  while (block_size * block_size < grid_size)
+    block_size++;
+
+  units->grid_size = grid_size;
+  units->block_size = block_size;
+  units->cells = grid_size * grid_size;
+  units->peers_per_cell = grid_size > 1 ? 3 * grid_size - 2 * block_size - 1
+    : 0;
+
+  units->unit_cells = malloc (3 * units->cells * sizeof (uint16_t));
+  units->cell_units = malloc (3 * units->cells * sizeof (uint16_t));
+  units->peers = malloc ((units->peers_per_cell * units->cells + 1)
+			 * sizeof (uint16_t));
+  units->block_row = malloc (grid_size * sizeof (uint16_t));
+  units->block_col = malloc (grid_size * sizeof (uint16_t));
+  if (units->unit_cells == NULL || units->cell_units == NULL
+      || units->peers == NULL || units->block_row == NULL
+      || units->block_col == NULL)
+    {
+      units_free (units);
+      return (NULL);
+    }
+
+  for (size_t k = 0; k < grid_size; k++)
+    {
+      units->block_row[k] = (k / block_size) * block_size;
+      units->block_col[k] = (k * block_size) % grid_size;
+    }
+
+  for (size_t u = 0; u < grid_size; u++)
+    for (size_t k = 0; k < grid_size; k++)
+      {
+	size_t i = units->block_row[u] + k / block_size;
+	size_t j = units->block_col[u] + k % block_size;
+
+	units->unit_cells[u * grid_size + k] = u * grid_size + k;
+	units->unit_cells[(grid_size + u) * grid_size + k] =
+	  k * grid_size + u;
+	units->unit_cells[(2 * grid_size + u) * grid_size + k] =
+	  i * grid_size + j;
+      }
+
+  for (size_t cell = 0; cell < units->cells; cell++)
+    {
+      size_t i = cell / grid_size;
+      size_t j = cell % grid_size;
+
+      units->cell_units[3 * cell]     = i;
+      units->cell_units[3 * cell + 1] = grid_size + j;
+      units->cell_units[3 * cell + 2] =
+	2 * grid_size + (i / block_size) * block_size + j / block_size;
+    }
+
+  /*
+   * The peers of a cell are the other cells of its row and column and
+   * the cells of its block on neither of them
+   */
+  for (size_t cell = 0; cell < units->cells; cell++)
+    {
+      size_t i = cell / grid_size;
+      size_t j = cell % grid_size;
+      uint16_t* peer = units->peers + cell * units->peers_per_cell;
+      const uint16_t* block =
+	unit_cells (units, units->cell_units[3 * cell + 2]);
+
+      for (size_t k = 0; k < grid_size; k++)
+	{
+	  if (k != j)
+	    *peer++ = i * grid_size + k;
+	  if (k != i)
+	    *peer++ = k * grid_size + j;
+	  if (block[k] / grid_size != i && block[k] % grid_size != j)
+	    *peer++ = block[k];
+	}
+    }
+
+  return (units);
+}
+
+const units_t*
+units_get (size_t grid_size)
+{
+  size_t block_size = 0;
+  units_t* units;
+
+  while (block_size * block_size < grid_size)
+    block_size++;
+  if (block_size > MAX_BLOCK_SIZE)
+    return (NULL);
+
+  pthread_mutex_lock (&tables_lock);
+  if (tables[block_size] == NULL)
+    tables[block_size] = units_build (grid_size);
+  units = tables[block_size];
+  pthread_mutex_unlock (&tables_lock);
+
+  return (units);
+}
@@ -0,0 +1,44 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdint.h>
+
+/*
+ * Tables describing the units (rows, columns and blocks) of the grids
+ * of one size. They are built once per size and shared by all the
+ * contexts, every cell is given by its index i * grid_size + j.
+ *
+ * Unit u is the row u for u < grid_size, the column u - grid_size for
+ * u < 2 * grid_size and the block u - 2 * grid_size otherwise. The
+ * cells of a block are listed row after row.
+ */
+typedef struct units {
+  size_t grid_size;
+  size_t block_size;
+  size_t cells;            /* grid_size * grid_size */
+  size_t peers_per_cell;   /* 3 * grid_size - 2 * block_size - 1 */
+
+  uint16_t* unit_cells;    /* grid_size cells for each of the units */
+  uint16_t* cell_units;    /* row, column and block of each cell */
+  uint16_t* peers;         /* peers_per_cell peers of each cell */
+  uint16_t* block_row;     /* first row of each block */
+  uint16_t* block_col;     /* first column of each block */
+} units_t;
+
+/*
+ * Returns the tables of the grids of size `grid_size`, building them
+ * on the first call, or NULL if it runs out of memory. It can be
+ * called from several threads at the same time.
+ */
+const units_t* units_get (size_t grid_size);
+
+/*
+ * Returns the cells of the unit `u`
+ */
+static inline const uint16_t*
+unit_cells (const units_t* units, size_t u)
+{
+  return (units->unit_cells + u * units->grid_size);
+}
+
+#endif /* UNITS_H */